@@ -0,0 +1,360 @@
+/*
+MIT License
+
+Copyright (c) 2020 singds
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* End to end benchmark: generate synthetic png images, convert each one to
+   every color format and rotation with the imgcvt library and print one tab
+   separated line per conversion. */
+
+//____________________________________________________________INCLUDES - DEFINES
+#define _POSIX_C_SOURCE 200809L
+#include "imgCvt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "lodepng/lodepng.h"
+
+#define L_NELEMENTS(array)                             (sizeof (array) / sizeof (array[0]))
+/* pixels converted by a measurement at least, small images are converted more times */
+#define L_MIN_PIXELS                                   (4u * 1024 * 1024)
+/* conversions of a measurement at least, the fastest one is reported */
+#define L_MIN_REPEAT                                   3
+/* side of the solid squares of flat images */
+#define L_FLAT_BLOCK                                   64
+
+#ifndef LODEPNG_COMPILE_ALLOCATORS
+void lodepng_free (void* ptr);
+#endif
+
+/* synthetic image content */
+typedef enum
+{
+    CONTENT_FLAT, // solid squares: long runs, the png filters barely matter
+    CONTENT_NOISY, // gradients with noise: every row needs its own filter
+} Content_e;
+
+/* a kind of png image to benchmark */
+typedef struct
+{
+    const char *name; // image kind name
+    LodePNGColorType colortype; // png color type
+    unsigned bitdepth; // png bit depth
+    unsigned interlace; // png interlace method
+    Content_e content; // pixel content
+    bool key; // black is the transparent color key of a tRNS chunk
+} Case_t;
+
+//____________________________________________________________PRIVATE PROTOTYPES
+static bool MakePng (const Case_t *c, uint32_t w, uint32_t h, const char *fname, size_t *pngSize);
+static uint8_t Noise (uint32_t *seed);
+static double Now (void);
+static bool Bench (const char *inFname, const char *outFname, int8_t clrFormat, int8_t ori, uint32_t pixels, double *seconds);
+
+//___________________________________________________________________PRIVATE VAR
+static const struct
+{
+    uint32_t w;
+    uint32_t h;
+} SizeTable[] =
+{
+    { 64, 64 }, // icon
+    { 480, 272 }, // small mcu display
+    { 1920, 1080 }, // full hd background
+};
+
+static const Case_t CaseTable[] =
+{
+    { "rgba8-flat",      LCT_RGBA,    8,  0, CONTENT_FLAT,  false },
+    { "rgba8-noisy",     LCT_RGBA,    8,  0, CONTENT_NOISY, false },
+    { "rgb8-flat",       LCT_RGB,     8,  0, CONTENT_FLAT,  false },
+    { "rgb8-noisy",      LCT_RGB,     8,  0, CONTENT_NOISY, false },
+    { "rgb8-key-flat",   LCT_RGB,     8,  0, CONTENT_FLAT,  true },
+    { "palette8-noisy",  LCT_PALETTE, 8,  0, CONTENT_NOISY, false },
+    { "grey8-flat",      LCT_GREY,    8,  0, CONTENT_FLAT,  false },
+    { "rgba16-noisy",    LCT_RGBA,    16, 0, CONTENT_NOISY, false },
+    { "rgba8-adam7",     LCT_RGBA,    8,  1, CONTENT_NOISY, false },
+    { "rgb8-adam7-flat", LCT_RGB,     8,  1, CONTENT_FLAT,  false },
+};
+
+/* output color format names, as accepted by -f */
+static const char *const FormatNameTable[] =
+{
+    [IMGCVT_CLR_FORMAT_ARGB8888] =  "argb8888",
+    [IMGCVT_CLR_FORMAT_BGRA8888] =  "bgra8888",
+    [IMGCVT_CLR_FORMAT_RGB565LE] =  "rgb565le",
+    [IMGCVT_CLR_FORMAT_RGB565BE] =  "rgb565be",
+    [IMGCVT_CLR_FORMAT_ARGB565LE] = "argb565le",
+    [IMGCVT_CLR_FORMAT_ARGB565BE] = "argb565be",
+    [IMGCVT_CLR_FORMAT_RGBA8888] =  "rgba8888",
+};
+
+static const int RotationTable[] =
+{
+    [IMGCVT_ORI_0] =   0,
+    [IMGCVT_ORI_90] =  90,
+    [IMGCVT_ORI_180] = 180,
+    [IMGCVT_ORI_270] = 270,
+};
+
+//______________________________________________________________GLOBAL FUNCTIONS
+
+/* Benchmark entry point.
+    Args:
+- <argc>[in] command line argument's number.
+- <argv>[in] command line argument's list, argv[1] is the work directory (default build/bench).
+    Ret:
+0 on success.
+*/
+int main (int argc, char *argv[])
+{
+    const char *dir = argc > 1 ? argv[1] : "build/bench";
+    char inFname[512];
+    char outFname[512];
+    bool ok = true;
+
+    mkdir (dir, 0777);
+    snprintf (outFname, sizeof (outFname), "%s/out.raw", dir);
+
+    printf ("image\twidth\theight\tcolortype\tbitdepth\tinterlace\tpng_bytes\tformat\trotation\traw_bytes\tseconds\tmb_s\tpixels_s\n");
+    for (size_t s = 0; s < L_NELEMENTS (SizeTable); s++)
+    {
+        for (size_t c = 0; c < L_NELEMENTS (CaseTable); c++)
+        {
+            const Case_t *cs = &CaseTable[c];
+            uint32_t w = SizeTable[s].w;
+            uint32_t h = SizeTable[s].h;
+            size_t pngSize;
+
+            snprintf (inFname, sizeof (inFname), "%s/%s-%ux%u.png", dir, cs->name, (unsigned)w, (unsigned)h);
+            if (!MakePng (cs, w, h, inFname, &pngSize))
+            {
+                fprintf (stderr, "%s: i can't generate the image\n", inFname);
+                ok = false;
+                continue;
+            }
+
+            for (int8_t f = 0; f < (int8_t)L_NELEMENTS (FormatNameTable); f++)
+            {
+                for (int8_t r = 0; r < (int8_t)L_NELEMENTS (RotationTable); r++)
+                {
+                    struct stat st;
+                    double seconds;
+
+                    if (!Bench (inFname, outFname, f, r, w * h, &seconds) || stat (outFname, &st) != 0)
+                    {
+                        fprintf (stderr, "%s: conversion failed\n", inFname);
+                        ok = false;
+                        continue;
+                    }
+                    printf ("%s\t%u\t%u\t%d\t%u\t%u\t%zu\t%s\t%d\t%lld\t%.6f\t%.1f\t%.0f\n",
+                            cs->name, (unsigned)w, (unsigned)h, (int)cs->colortype, cs->bitdepth, cs->interlace,
+                            pngSize, FormatNameTable[f], RotationTable[r], (long long)st.st_size, seconds,
+                            st.st_size / seconds / 1e6, (double)w * h / seconds);
+                    fflush (stdout);
+                }
+            }
+            remove (inFname);
+        }
+    }
+    remove (outFname);
+    return ok ? 0 : 1;
+}
+
+//_____________________________________________________________PRIVATE FUNCTIONS
+
+/* Generate and save a synthetic png image, checking that lodepng decodes it
+   back to the same pixels.
+    Args: <c>[in] kind of image.
+          <w>[in] image width.
+          <h>[in] image height.
+          <fname>[in] png file path.
+          <pngSize>[out] png file size.
+    Ret: true on success.
+*/
+static bool MakePng (const Case_t *c, uint32_t w, uint32_t h, const char *fname, size_t *pngSize)
+{
+    size_t bytesPxl = c->bitdepth == 16 ? 8 : 4;
+    uint8_t *img = malloc ((size_t)w * h * bytesPxl);
+    uint8_t *png = NULL;
+    uint8_t *dec = NULL;
+    unsigned decW, decH;
+    uint32_t seed = 0x1234567u;
+    LodePNGState state;
+    unsigned error;
+
+    if (img == NULL)
+        return false;
+
+    lodepng_state_init (&state);
+    state.encoder.auto_convert = 0;
+    state.info_raw.colortype = LCT_RGBA;
+    state.info_raw.bitdepth = c->bitdepth;
+    state.info_png.color.colortype = c->colortype;
+    state.info_png.color.bitdepth = c->bitdepth;
+    state.info_png.interlace_method = c->interlace;
+    if (c->colortype == LCT_PALETTE)
+    {
+        for (unsigned i = 0; i < 256; i++)
+            lodepng_palette_add (&state.info_png.color, i * 37, i * 91, i * 13, 255 - i / 2);
+    }
+    state.info_png.color.key_defined = c->key; // key_r, key_g and key_b are 0
+
+    for (uint32_t y = 0; y < h; y++)
+    {
+        for (uint32_t x = 0; x < w; x++)
+        {
+            uint8_t px[4];
+
+            if (c->content == CONTENT_FLAT)
+            {
+                uint32_t block = (x / L_FLAT_BLOCK) * 7 + (y / L_FLAT_BLOCK) * 13;
+
+                px[0] = block * 29;
+                px[1] = block * 53;
+                px[2] = block * 97;
+                px[3] = 255 - block % 4 * 60;
+            }
+            else
+            {
+                px[0] = x + Noise (&seed) % 8;
+                px[1] = y + Noise (&seed) % 8;
+                px[2] = (x + y) / 2 + Noise (&seed) % 8;
+                px[3] = x * 2 + Noise (&seed) % 4;
+            }
+
+            /* only colors the png color type can hold */
+            if (c->colortype == LCT_PALETTE)
+            {
+                const uint8_t *pal = &state.info_png.color.palette[(px[0] ^ px[1]) * 4];
+
+                memcpy (px, pal, 4);
+            }
+            if (c->colortype == LCT_GREY || c->colortype == LCT_GREY_ALPHA)
+                px[1] = px[2] = px[0];
+            if (c->colortype == LCT_GREY || c->colortype == LCT_RGB)
+                px[3] = 255;
+            if (c->key && px[0] == 0 && px[1] == 0 && px[2] == 0)
+                px[3] = 0;
+
+            size_t i = ((size_t)y * w + x) * bytesPxl;
+            for (int k = 0; k < 4; k++)
+            {
+                if (bytesPxl == 8)
+                {
+                    img[i + k * 2] = px[k];
+                    img[i + k * 2 + 1] = k == 3 && px[3] == 255 ? 255 : Noise (&seed);
+                }
+                else
+                    img[i + k] = px[k];
+            }
+        }
+    }
+
+    error = lodepng_encode (&png, pngSize, img, w, h, &state);
+    if (!error)
+        error = lodepng_decode_memory (&dec, &decW, &decH, png, *pngSize, LCT_RGBA, c->bitdepth);
+    if (!error && (decW != w || decH != h || memcmp (dec, img, (size_t)w * h * bytesPxl) != 0))
+    {
+        fprintf (stderr, "%s: the decoded pixels differ from the encoded ones\n", fname);
+        error = 1;
+    }
+    if (!error)
+        error = lodepng_save_file (png, *pngSize, fname);
+
+    lodepng_state_cleanup (&state);
+#ifdef LODEPNG_COMPILE_ALLOCATORS
+    free (png);
+    free (dec);
+#else
+    lodepng_free (png); // lodepng memory comes from the allocators of imgCvt.c
+    lodepng_free (dec);
+#endif
+    free (img);
+    return error == 0;
+}
+
+/* Get a pseudo random byte (xorshift32), the same sequence on every run.
+    Args: <seed>[in/out] generator state.
+    Ret: the random byte.
+*/
+static uint8_t Noise (uint32_t *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed >> 24;
+}
+
+/* Get the monotonic clock.
+    Args:
+    Ret: seconds.
+*/
+static double Now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Time the conversion of an image file, repeated until L_MIN_PIXELS pixels
+   and L_MIN_REPEAT conversions are done.
+    Args: <inFname>[in] png file path.
+          <outFname>[in] raw file path.
+          <clrFormat>[in] output color format.
+          <ori>[in] output orientation.
+          <pixels>[in] image pixels.
+          <seconds>[out] time of the fastest conversion.
+    Ret: true on success.
+*/
+static bool Bench (const char *inFname, const char *outFname, int8_t clrFormat, int8_t ori, uint32_t pixels, double *seconds)
+{
+    uint32_t repeat = L_MIN_PIXELS / pixels;
+    imgcvt_Ctx_t ctx;
+
+    imgcvt_CtxInit (&ctx);
+    ctx.in_fname = inFname;
+    ctx.out_fname = outFname;
+    ctx.clr_format = clrFormat;
+    ctx.ori = ori;
+
+    if (repeat < L_MIN_REPEAT)
+        repeat = L_MIN_REPEAT;
+    *seconds = 0;
+    for (uint32_t i = 0; i < repeat; i++)
+    {
+        double start = Now ( );
+
+        if (imgcvt_CtxConvert (&ctx) != IMGCVT_OK)
+            return false;
+
+        double t = Now ( ) - start;
+        if (i == 0 || t < *seconds)
+            *seconds = t;
+    }
+    return true;
+}
@@ -23,77 +23,471 @@ SOFTWARE.
 */
 
 //____________________________________________________________INCLUDES - DEFINES
+#if !defined(IMGCVT_MCU) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
 #include "imgCvt.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #if !defined(IMGCVT_MCU)
+#include <time.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(IMGCVT_MCU)
+/* x86 vector kernels, each one compiled for its own target and picked at run time */
+#define L_X86_KERNELS
+#include <immintrin.h>
 #endif
 #include "lodepng/lodepng.h"
 
 #define L_PRINT_GEN_ERR                                fprintf (stderr, "ERROR ON %s:%d\n", __FILE__, __LINE__)
 #define L_NELEMENTS(array)                             (sizeof (array) / sizeof (array[0]))
+/* raw image header size, pixels start right after it */
+#define L_HEADER_SIZE                                  32
+/* size of the output staging buffer, flushed with a single fwrite when full */
+#define L_OUT_BUF_SIZE                                 (64 * 1024)
+/* phase timers of --stats, compiled out unless the build defines IMGCVT_STATS */
+#if defined(IMGCVT_STATS) && !defined(IMGCVT_MCU)
+#if !defined(LODEPNG_COMPILE_STATS)
+#error "IMGCVT_STATS needs LODEPNG_COMPILE_STATS, for lodepng.c too"
+#endif
+#define L_STATS
+#define L_STATS_BEGIN(start)                           double start = StatsNow ( )
+#define L_STATS_ADD(stats, start, phase, n)            StatsAdd (stats, &start, phase, n, -1)
+#define L_STATS_NESTED(stats, start, phase, n, outer)  StatsAdd (stats, &start, phase, n, outer)
+#else
+#define L_STATS_BEGIN(start)
+#define L_STATS_ADD(stats, start, phase, n)
+#define L_STATS_NESTED(stats, start, phase, n, outer)
+#endif
+/* lodepng memory of a conversion taken from an arena of the converting thread, dropped at once after every image */
+#if defined(IMGCVT_ARENA)
+#if defined(LODEPNG_COMPILE_ALLOCATORS)
+#error "IMGCVT_ARENA needs LODEPNG_NO_COMPILE_ALLOCATORS, for lodepng.c too"
+#endif
+#define L_ARENA
+#define L_ARENA_ALIGN                                  16
+#define L_ARENA_ROUND(n)                               (((n) + L_ARENA_ALIGN - 1) & ~(size_t)(L_ARENA_ALIGN - 1))
+/* no block, in the offsets of the arena blocks */
+#define L_ARENA_NONE                                   ((size_t)-1)
+/* flags in the size of an arena block */
+#define L_ARENA_FREED                                  1
+#define L_ARENA_HEAP                                   2
+/* smallest arena chunk */
+#define L_ARENA_CHUNK                                  (1024 * 1024)
+/* most arena memory a thread keeps from an image to the next one */
+#define L_ARENA_KEEP                                   (64 * 1024 * 1024)
+#define L_ARENA_BEGIN                                  ArenaBegin ( )
+#define L_ARENA_END                                    ArenaEnd ( )
+#else
+#define L_ARENA_BEGIN
+#define L_ARENA_END
+#endif
+/* image columns transposed together by the rotated traversals (16 RGBA pixels = one 64 byte cache line) */
+#define L_TILE_COLS                                    16
+/* fewest pixels worth a conversion thread of their own */
+#define L_BAND_MIN_PIXELS                              (256 * 1024)
+
+/* output staging buffer: pixels are converted here and flushed in large writes.
+   Without a stream the buffer is the final destination and is never flushed. */
+typedef struct
+{
+    FILE *f; // destination stream, NULL when writing to memory
+    uint8_t *buf; // staging buffer
+    size_t len; // number of bytes currently staged
+    size_t size; // staging buffer capacity
+    imgcvt_Stats_t *stats; // the flushes are timed here, NULL when not timed
+} OutBuf_t;
+
+#if defined(L_ARENA)
+/* arena chunk, its blocks follow the header one after the other */
+typedef struct ArenaChunk_s
+{
+    struct ArenaChunk_s *prev; // older chunk, NULL for the first one
+    size_t size; // bytes for the blocks
+    size_t used; // bytes taken by the blocks
+    size_t last; // offset of the newest block, L_ARENA_NONE when empty
+} ArenaChunk_t;
+
+/* header of an arena block, right before the memory given out */
+typedef struct
+{
+    size_t size; // block capacity, ored with L_ARENA_FREED when freed or with L_ARENA_HEAP for a heap block
+    size_t prev; // offset of the block before it in the chunk, L_ARENA_NONE for the first one
+} ArenaBlock_t;
+
+/* bump allocator of a thread */
+typedef struct
+{
+    ArenaChunk_t *top; // chunk the new blocks are taken from, NULL when there is none
+    unsigned depth; // conversions in progress, outside of them the blocks come from the heap
+    bool registered; // the chunks are released when the thread exits
+} Arena_t;
+
+#define L_ARENA_CHUNK_HDR                              L_ARENA_ROUND (sizeof (ArenaChunk_t))
+#define L_ARENA_BLOCK_HDR                              L_ARENA_ROUND (sizeof (ArenaBlock_t))
+#define L_ARENA_BLOCK(chunk, offset)                   ((ArenaBlock_t *)((uint8_t *)(chunk) + L_ARENA_CHUNK_HDR + (offset)))
+#endif
+
+#if defined(L_X86_KERNELS)
+#define L_TARGET(isa)                                  __attribute__ ((target (isa)))
+#define L_X86(func)                                    func
+#else
+#define L_X86(func)                                    NULL
+#endif
 
-typedef imgcvt_Result_e (*FuncWritePxl_t) (FILE *f, uint8_t *inClr);
-typedef imgcvt_Result_e (*FuncTraversePixel_t) (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl);
+/* conversion kernel variants, from the most portable to the fastest */
+typedef enum
+{
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_SSSE3,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    KERNEL_NUM,
+} Kernel_e;
+
+typedef void (*FuncWriteRow_t) (uint8_t *out, const uint8_t *in, uint32_t n);
+typedef imgcvt_Result_e (*FuncTraversePixel_t) (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl);
+typedef imgcvt_Result_e (*FuncTraverseFmt_t) (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num);
 void lodepng_free (void* ptr);
+#if defined(L_ARENA)
+void* lodepng_malloc (size_t size);
+void* lodepng_realloc (void* ptr, size_t new_size);
+#endif
+
+/* output raw file, written through a memory mapping when possible */
+typedef struct
+{
+    FILE *f; // stream of the file when it is not mapped
+    uint8_t *map; // mapping of the whole file, NULL when written with stdio
+    size_t size; // file size
+    bool regular; // regular file, not a fifo or a device
+    bool created; // the file did not exist before the conversion
+} OutFile_t;
+
+/* bytes of an input png file */
+typedef struct
+{
+    uint8_t *data; // file content
+    size_t size; // file size
+    bool mapped; // data is a read only mapping of the file, not a lodepng buffer
+} InFile_t;
+
+/* destination of the rows of a streaming decode */
+typedef struct
+{
+    OutBuf_t *ob; // output buffer, used as a band of rows for 180°
+    FuncWriteRow_t wr_row; // row conversion kernel
+    uint8_t bytes_pxl; // output bytes per pixel
+    uint32_t w; // image width
+    uint32_t h; // image height
+    uint8_t *rev; // mirrored RGBA8888 row for 180°, NULL for 0°
+    uint8_t *pixels; // 180° in memory: first pixel of the image, NULL when written by band
+    uint32_t band_rows; // rows held by the output buffer for 180°
+    bool failed; // an output write failed
+} RowSink_t;
+
+/* decoder memory kept from an image to the next one, by a batch worker */
+typedef struct
+{
+    LodePNGState state; // decoder settings, the png header is cleared after every image
+    LodePNGDecoderScratch scratch; // lookup tables of inflate, the fixed ones are built once
+} Decoder_t;
 
-//____________________________________________________________PRIVATE PROTOTYPES
 #if !defined(IMGCVT_MCU)
+/* build of the converter, part of the conversion cache key so the entries of
+   another build are never used. The Makefile passes a hash of the sources,
+   other builds fall back to the compilation time. */
+#if defined(IMGCVT_BUILD_ID)
+#define L_BUILD_ID                                     IMGCVT_BUILD_ID
+#else
+#define L_BUILD_ID                                     __DATE__ " " __TIME__
+#endif
+/* conversion cache entry header, the raw image follows it: magic (8 bytes),
+   SHA-256 of the png (32), png size (8, big endian), color format (1),
+   orientation (1), zeros up to byte 64, build id (NUL padded up to 128) */
+#define L_CACHE_HDR_SIZE                               128
+#define L_CACHE_MAGIC                                  "IMGCVTC1"
+#define L_ROTR32(x, n)                                 (((x) >> (n)) | ((x) << (32 - (n))))
+/* most threads accepted by -j */
+#define L_MAX_THREADS                                  1024
+/* longest line accepted in a manifest file */
+#define L_MANIFEST_LINE                                4096
+
+/* job queue of a batch worker: a range of job indices. The owner takes jobs
+   from the front, an idle worker steals the back half. */
+typedef struct
+{
+    size_t head; // next job of the owner
+    size_t tail; // one past the last queued job
+    pthread_mutex_t lock; // protects head and tail
+} WorkQueue_t;
+
+/* images shared by the batch worker threads */
+typedef struct
+{
+    imgcvt_Ctx_t *jobs; // one conversion per input image
+    size_t num; // number of jobs
+    WorkQueue_t *queues; // one queue per worker
+    unsigned nWorkers; // number of workers
+    size_t failed; // number of failed jobs
+    pthread_mutex_t lock; // protects failed
+} Batch_t;
+
+/* conversion cache entry of an image */
+typedef struct
+{
+    char *path; // entry file path, allocated with malloc
+    uint8_t hdr[L_CACHE_HDR_SIZE]; // header of the entry: the whole key of the conversion
+    size_t rawSize; // size of the raw image that follows the header
+} CacheEntry_t;
+
+/* SHA-256 hash in progress */
+typedef struct
+{
+    uint32_t state[8]; // hash of the blocks done
+    uint64_t bytes; // bytes hashed so far
+    uint8_t block[64]; // partial block not hashed yet
+} Sha256_t;
+
+/* argument of a batch worker thread */
+typedef struct
+{
+    Batch_t *batch; // the shared batch
+    unsigned id; // index of the worker own queue
+} Worker_t;
+
+/* band of output rows converted by a conversion thread */
+typedef struct
+{
+    const imgcvt_Ctx_t *ctx; // conversion options
+    OutBuf_t ob; // the band place in the output memory
+    const uint8_t *img; // RGBA8888 pixel map
+    uint32_t w; // image width
+    uint32_t h; // image height
+    uint32_t first; // first output row of the band
+    uint32_t num; // number of output rows of the band
+    bool threaded; // converted by a thread of its own
+    imgcvt_Result_e result; // conversion result
+} Band_t;
+#endif
+
+//____________________________________________________________PRIVATE PROTOTYPES
+#if !defined(IMGCVT_MCU) && !defined(IMGCVT_NO_MAIN)
 static void PrintHelp (void);
+static int8_t ParseClrFormat (const char *name);
+static int8_t ParseOri (const char *degrees);
+static char *MakeOutFname (const char *outDir, const char *inFname);
+static imgcvt_Result_e LoadManifest (const char *fname, const imgcvt_Ctx_t *defaults, imgcvt_Ctx_t **jobs, size_t *num);
+static imgcvt_Result_e ParseManifestLine (char *line, imgcvt_Ctx_t *job);
+static void FreeJobs (imgcvt_Ctx_t *jobs, size_t num);
+static int CmpOutFname (const void *a, const void *b);
+static imgcvt_Result_e CheckOutFnames (const imgcvt_Ctx_t *jobs, size_t num);
+static bool PopJob (WorkQueue_t *q, size_t *job);
+static bool StealJobs (Batch_t *batch, unsigned id);
+static void *BatchWorker (void *arg);
+static size_t RunBatch (imgcvt_Ctx_t *jobs, size_t num, unsigned nThreads);
+static void PrintStats (const char *name, const imgcvt_Stats_t *stats);
+static imgcvt_Result_e DecoderInit (Decoder_t *dec);
+static void DecoderCleanup (Decoder_t *dec);
+#endif
+#if !defined(IMGCVT_MCU)
+static imgcvt_Result_e CacheEntryInit (CacheEntry_t *entry, const imgcvt_Ctx_t *ctx, const uint8_t *png, size_t pngSize);
+static imgcvt_Result_e CopyFile (FILE *src, FILE *dst);
+static imgcvt_Result_e CacheLoad (const CacheEntry_t *entry, const char *outFname);
+static void CacheStore (const CacheEntry_t *entry, const char *cacheDir, const char *outFname);
+static void Sha256Init (Sha256_t *sha);
+static void Sha256Block (uint32_t state[8], const uint8_t *block);
+static void Sha256Update (Sha256_t *sha, const uint8_t *data, size_t size);
+static void Sha256Final (Sha256_t *sha, uint8_t digest[32]);
+static void *BandWorker (void *arg);
+static imgcvt_Result_e TraverseBands (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, const uint8_t *image, uint32_t width, uint32_t height, unsigned nBands);
+#endif
+#if defined(L_STATS)
+static double StatsNow (void);
+static void StatsAdd (imgcvt_Stats_t *stats, double *start, int phase, uint64_t bytes, int outer);
+static void StatsAddDecoder (imgcvt_Stats_t *stats, const LodePNGDecodeStats *dec, int outer);
+#endif
+static imgcvt_Result_e Convert (const imgcvt_Ctx_t *ctx, Decoder_t *dec);
+static unsigned InFileLoad (InFile_t *in, const char *fname);
+static void InFileRelease (InFile_t *in);
+static imgcvt_Result_e ConvertMemory (const imgcvt_Ctx_t *ctx, const uint8_t *png, size_t pngSize, uint8_t **out, size_t *outSize);
+static unsigned DecodeImage (const imgcvt_Ctx_t *ctx, Decoder_t *dec, uint8_t **image, uint32_t *width, uint32_t *height, const uint8_t *png, size_t pngSize);
+static imgcvt_Result_e WriteRaw (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, const uint8_t *image, uint32_t width, uint32_t height);
+static imgcvt_Result_e WriteHeader (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, uint32_t width, uint32_t height);
+static imgcvt_Result_e TraverseBand (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, const uint8_t *image, uint32_t width, uint32_t height, uint32_t first, uint32_t num);
+static FuncWriteRow_t CtxWriteRow (const imgcvt_Ctx_t *ctx);
+static bool CanStream (const imgcvt_Ctx_t *ctx, Decoder_t *dec, const uint8_t *png, size_t pngSize, uint32_t *width, uint32_t *height);
+static imgcvt_Result_e StreamRaw (const imgcvt_Ctx_t *ctx, Decoder_t *dec, OutBuf_t *ob, const uint8_t *png, size_t pngSize, uint32_t width, uint32_t height);
+static unsigned StreamRow (void *context, unsigned y, const unsigned char *row);
+static void FreeImage (uint8_t *image);
+static LodePNGState *DecoderAcquire (const imgcvt_Ctx_t *ctx, Decoder_t *dec, LodePNGState *local);
+static void DecoderRelease (Decoder_t *dec, LodePNGState *state);
+#if defined(L_ARENA)
+static ArenaChunk_t *ArenaChunkNew (size_t size, ArenaChunk_t *prev);
+static void ArenaRegister (Arena_t *arena);
+static void ArenaFreeChunks (ArenaChunk_t *top);
+#if !defined(IMGCVT_MCU)
+static void ArenaThreadExit (void *arg);
+static void ArenaKeyCreate (void);
+#endif
+static void ArenaBegin (void);
+static void ArenaEnd (void);
 #endif
-static imgcvt_Result_e Convert (void);
 static imgcvt_Result_e Fwrite (void *ptr, size_t size, FILE *stream);
 static void GetBeInt32t (uint8_t *leVal, int32_t val);
 
-static imgcvt_Result_e WriteClrARGB8888 (FILE *f, uint8_t *inClr);
-static imgcvt_Result_e WriteClrBGRA8888 (FILE *f, uint8_t *inClr);
-static imgcvt_Result_e WriteClrRGB565LE (FILE *f, uint8_t *inClr);
-static imgcvt_Result_e WriteClrRGB565BE (FILE *f, uint8_t *inClr);
-static imgcvt_Result_e WriteClrARGB565LE (FILE *f, uint8_t *inClr);
-static imgcvt_Result_e WriteClrARGB565BE (FILE *f, uint8_t *inClr);
-static imgcvt_Result_e WriteClrRGBA8888 (FILE *f, uint8_t *inClr);
+static imgcvt_Result_e OutBufInit (OutBuf_t *ob, FILE *f, size_t minSize);
+static void OutBufInitMem (OutBuf_t *ob, uint8_t *dst, size_t size);
+static void OutBufCleanup (OutBuf_t *ob);
+static uint8_t *OutBufReserve (OutBuf_t *ob, size_t n);
+static imgcvt_Result_e OutBufFlush (OutBuf_t *ob);
+static imgcvt_Result_e OutFileOpen (OutFile_t *of, OutBuf_t *ob, const char *fname, size_t size, size_t minBufSize);
+static imgcvt_Result_e OutFileClose (OutFile_t *of, OutBuf_t *ob);
+static void OutFileDiscard (const OutFile_t *of, const char *fname);
+
+/* prototypes of the scalar kernels generated by L_DEFINE_FORMAT_KERNELS */
+#define L_DECLARE_FORMAT_KERNELS(fmt) \
+static inline void Pxl##fmt (uint8_t *out, const uint8_t *in); \
+static void WriteClr##fmt (uint8_t *out, const uint8_t *in, uint32_t n); \
+static imgcvt_Result_e TraverseOri0##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num); \
+static imgcvt_Result_e TraverseOri90##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num); \
+static imgcvt_Result_e TraverseOri180##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num); \
+static imgcvt_Result_e TraverseOri270##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num);
+
+L_DECLARE_FORMAT_KERNELS (ARGB8888)
+L_DECLARE_FORMAT_KERNELS (BGRA8888)
+L_DECLARE_FORMAT_KERNELS (RGB565LE)
+L_DECLARE_FORMAT_KERNELS (RGB565BE)
+L_DECLARE_FORMAT_KERNELS (ARGB565LE)
+L_DECLARE_FORMAT_KERNELS (ARGB565BE)
+L_DECLARE_FORMAT_KERNELS (RGBA8888)
+#if defined(L_X86_KERNELS)
+static L_TARGET ("sse2") void WriteClrARGB8888Sse2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("sse2") void WriteClrBGRA8888Sse2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static inline L_TARGET ("sse2") __m128i Rgb565Sse2 (__m128i p);
+static inline L_TARGET ("sse2") __m128i Pack565Sse2 (const uint8_t *in);
+static L_TARGET ("sse2") void WriteClrRGB565LESse2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("sse2") void WriteClrRGB565BESse2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("sse2") void WriteClrARGB565Sse2 (uint8_t *out, const uint8_t *in, uint32_t n, bool be);
+static L_TARGET ("sse2") void WriteClrARGB565LESse2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("sse2") void WriteClrARGB565BESse2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("ssse3") uint32_t ShuffleRowSsse3 (uint8_t *out, const uint8_t *in, uint32_t n, __m128i mask);
+static L_TARGET ("ssse3") void WriteClrARGB8888Ssse3 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("ssse3") void WriteClrBGRA8888Ssse3 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("ssse3") uint32_t ARGB565RowSsse3 (uint8_t *out, const uint8_t *in, uint32_t n, __m128i mask);
+static L_TARGET ("ssse3") void WriteClrARGB565LESsse3 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("ssse3") void WriteClrARGB565BESsse3 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx2") uint32_t ShuffleRowAvx2 (uint8_t *out, const uint8_t *in, uint32_t n, __m256i mask);
+static L_TARGET ("avx2") void WriteClrARGB8888Avx2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx2") void WriteClrBGRA8888Avx2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static inline L_TARGET ("avx2") __m256i Rgb565Avx2 (__m256i p);
+static L_TARGET ("avx2") uint32_t RGB565RowAvx2 (uint8_t *out, const uint8_t *in, uint32_t n, bool be);
+static L_TARGET ("avx2") void WriteClrRGB565LEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx2") void WriteClrRGB565BEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx2") uint32_t ARGB565RowAvx2 (uint8_t *out, const uint8_t *in, uint32_t n, __m256i mask);
+static L_TARGET ("avx2") void WriteClrARGB565LEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx2") void WriteClrARGB565BEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx512f,avx512bw") uint32_t ShuffleRowAvx512 (uint8_t *out, const uint8_t *in, uint32_t n, __m512i mask);
+static L_TARGET ("avx512f,avx512bw") void WriteClrARGB8888Avx512 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx512f,avx512bw") void WriteClrBGRA8888Avx512 (uint8_t *out, const uint8_t *in, uint32_t n);
+static inline L_TARGET ("avx512f,avx512bw") __m512i Rgb565Avx512 (__m512i p);
+static L_TARGET ("avx512f,avx512bw") uint32_t RGB565RowAvx512 (uint8_t *out, const uint8_t *in, uint32_t n, bool be);
+static L_TARGET ("avx512f,avx512bw") void WriteClrRGB565LEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx512f,avx512bw") void WriteClrRGB565BEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx512f,avx512bw") uint32_t ARGB565RowAvx512 (uint8_t *out, const uint8_t *in, uint32_t n, __m512i mask);
+static L_TARGET ("avx512f,avx512bw") void WriteClrARGB565LEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n);
+static L_TARGET ("avx512f,avx512bw") void WriteClrARGB565BEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n);
+#endif
+
 
+static imgcvt_Result_e TraversePixelOri0   (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl);
+static imgcvt_Result_e TraversePixelOri90  (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl);
+static imgcvt_Result_e TraversePixelOri180 (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl);
+static imgcvt_Result_e TraversePixelOri270 (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl);
+static void GatherColumns (uint8_t *band, const uint8_t *img, uint32_t w, uint32_t h, uint32_t x, uint32_t nCols, bool cw);
+static imgcvt_Result_e TraversePixelColumns (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl, bool cw);
 
-static imgcvt_Result_e TraversePixelOri0   (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl);
-static imgcvt_Result_e TraversePixelOri90  (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl);
-static imgcvt_Result_e TraversePixelOri180 (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl);
-static imgcvt_Result_e TraversePixelOri270 (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl);
+static Kernel_e DetectKernel (void);
+static FuncWriteRow_t SelectWriteRow (int8_t clrFormat, Kernel_e kernel);
 
 //___________________________________________________________________PRIVATE VAR
-/* image file path */
-static const char *ArgIn_FnameImg = NULL;
-/* output file path */
-static const char *ArgIn_FnameOut = NULL;
-/* output color format */
-static int8_t ArgIn_ClrFomat = IMGCVT_CLR_FORMAT_ARGB8888;
-/* output pxl orientation */
-static int8_t ArgIn_Ori = IMGCVT_ORI_0;
-
-/* pixel write function (default RGBA8888 output) */
-FuncWritePxl_t WritePxl = WriteClrARGB8888;
+/* specialized scalar traversals of a color format, indexed by orientation */
+#define L_FORMAT_TRAVERSALS(fmt) \
+    { \
+        [IMGCVT_ORI_0] =   TraverseOri0##fmt, \
+        [IMGCVT_ORI_90] =  TraverseOri90##fmt, \
+        [IMGCVT_ORI_180] = TraverseOri180##fmt, \
+        [IMGCVT_ORI_270] = TraverseOri270##fmt, \
+    }
 
-struct
+static const struct
 {
     const char *name; // color format string name
-    FuncWritePxl_t func_write;
+    uint8_t bytes_pxl; // output bytes per pixel
+    FuncWriteRow_t func_write[KERNEL_NUM]; // converts a row of RGBA8888 pixels, NULL if the variant is missing
+    FuncTraverseFmt_t func_traverse[4]; // scalar conversion fused into the traversal, one per orientation
 } PxlFormatTable[] =
 {
-    [IMGCVT_CLR_FORMAT_ARGB8888] =  { "argb8888", WriteClrARGB8888 },
-    [IMGCVT_CLR_FORMAT_BGRA8888] =  { "bgra8888", WriteClrBGRA8888 },
-    [IMGCVT_CLR_FORMAT_RGB565LE] =  { "rgb565le", WriteClrRGB565LE },
-    [IMGCVT_CLR_FORMAT_RGB565BE] =  { "rgb565be", WriteClrRGB565BE },
-    [IMGCVT_CLR_FORMAT_ARGB565LE] = { "argb565le", WriteClrARGB565LE },
-    [IMGCVT_CLR_FORMAT_ARGB565BE] = { "argb565be", WriteClrARGB565BE },
-    [IMGCVT_CLR_FORMAT_RGBA8888] = { "rgba8888", WriteClrRGBA8888 },
+    [IMGCVT_CLR_FORMAT_ARGB8888] =  { "argb8888", 4,
+        { WriteClrARGB8888, L_X86 (WriteClrARGB8888Sse2), L_X86 (WriteClrARGB8888Ssse3), L_X86 (WriteClrARGB8888Avx2), L_X86 (WriteClrARGB8888Avx512) },
+        L_FORMAT_TRAVERSALS (ARGB8888) },
+    [IMGCVT_CLR_FORMAT_BGRA8888] =  { "bgra8888", 4,
+        { WriteClrBGRA8888, L_X86 (WriteClrBGRA8888Sse2), L_X86 (WriteClrBGRA8888Ssse3), L_X86 (WriteClrBGRA8888Avx2), L_X86 (WriteClrBGRA8888Avx512) },
+        L_FORMAT_TRAVERSALS (BGRA8888) },
+    [IMGCVT_CLR_FORMAT_RGB565LE] =  { "rgb565le", 2,
+        { WriteClrRGB565LE, L_X86 (WriteClrRGB565LESse2), NULL, L_X86 (WriteClrRGB565LEAvx2), L_X86 (WriteClrRGB565LEAvx512) },
+        L_FORMAT_TRAVERSALS (RGB565LE) },
+    [IMGCVT_CLR_FORMAT_RGB565BE] =  { "rgb565be", 2,
+        { WriteClrRGB565BE, L_X86 (WriteClrRGB565BESse2), NULL, L_X86 (WriteClrRGB565BEAvx2), L_X86 (WriteClrRGB565BEAvx512) },
+        L_FORMAT_TRAVERSALS (RGB565BE) },
+    [IMGCVT_CLR_FORMAT_ARGB565LE] = { "argb565le", 3,
+        { WriteClrARGB565LE, L_X86 (WriteClrARGB565LESse2), L_X86 (WriteClrARGB565LESsse3), L_X86 (WriteClrARGB565LEAvx2), L_X86 (WriteClrARGB565LEAvx512) },
+        L_FORMAT_TRAVERSALS (ARGB565LE) },
+    [IMGCVT_CLR_FORMAT_ARGB565BE] = { "argb565be", 3,
+        { WriteClrARGB565BE, L_X86 (WriteClrARGB565BESse2), L_X86 (WriteClrARGB565BESsse3), L_X86 (WriteClrARGB565BEAvx2), L_X86 (WriteClrARGB565BEAvx512) },
+        L_FORMAT_TRAVERSALS (ARGB565BE) },
+    [IMGCVT_CLR_FORMAT_RGBA8888] = { "rgba8888", 4,
+        { WriteClrRGBA8888 },
+        L_FORMAT_TRAVERSALS (RGBA8888) },
+};
+
+#if !defined(IMGCVT_MCU) && !defined(IMGCVT_NO_MAIN)
+/* conversion kernel names, as accepted by --kernel */
+static const char *const KernelNameTable[] =
+{
+    [KERNEL_SCALAR] = "scalar",
+    [KERNEL_SSE2] =   "sse2",
+    [KERNEL_SSSE3] =  "ssse3",
+    [KERNEL_AVX2] =   "avx2",
+    [KERNEL_AVX512] = "avx512",
 };
+#endif
+
+#if defined(L_ARENA)
+/* arena of the calling thread */
+#if defined(IMGCVT_MCU)
+static Arena_t ThreadArena;
+#else
+static __thread Arena_t ThreadArena;
+/* releases the arena of an exiting thread */
+static pthread_key_t ArenaKey;
+static pthread_once_t ArenaKeyOnce = PTHREAD_ONCE_INIT;
+#endif
+#endif
 
-/* pixel traversal function (default rotation 0) */
-FuncTraversePixel_t TraversePixel = TraversePixelOri0;
-FuncTraversePixel_t TraversePixelTable[] =
+/* pixel traversal functions used with the vector row kernels */
+static const FuncTraversePixel_t TraversePixelTable[] =
 {
     [IMGCVT_ORI_0] =   TraversePixelOri0,
     [IMGCVT_ORI_90] =  TraversePixelOri90,
@@ -106,25 +500,88 @@ FuncTraversePixel_t TraversePixelTable[] =
 //______________________________________________________________GLOBAL FUNCTIONS
 
 /*______________________________________________________________________________
- Desc:  Descrizione funzione.
- Arg: - None.
+ Desc:  Initialize a conversion context with the default options.
+ Arg: - <ctx>[out] the context.
  Ret: - None.
 ______________________________________________________________________________*/
+void imgcvt_CtxInit (imgcvt_Ctx_t *ctx)
+{
+    ctx->in_fname = NULL;
+    ctx->out_fname = NULL;
+    ctx->clr_format = IMGCVT_CLR_FORMAT_ARGB8888;
+    ctx->ori = IMGCVT_ORI_0;
+    ctx->kernel = -1;
+    ctx->cache_dir = NULL;
+    ctx->stats = NULL;
+    ctx->threads = 1;
+    ctx->ignore_crc = false;
+}
+
+/*______________________________________________________________________________
+ Desc:  Convert the image described by a context. The context is only read,
+        any number of contexts can be converted at the same time.
+ Arg: - <ctx>[in] the context.
+ Ret: - IMGCVT_OK on success, IMGCVT_ERR_ARG if an option is not valid.
+______________________________________________________________________________*/
+imgcvt_Result_e imgcvt_CtxConvert (const imgcvt_Ctx_t *ctx)
+{
+    if (ctx == NULL || ctx->in_fname == NULL || ctx->out_fname == NULL ||
+        ctx->clr_format < 0 || ctx->clr_format >= (int8_t)L_NELEMENTS (PxlFormatTable) ||
+        ctx->ori < 0 || ctx->ori >= (int8_t)L_NELEMENTS (TraversePixelTable) ||
+        ctx->kernel < -1 || ctx->kernel > (int8_t)DetectKernel ( ))
+        return IMGCVT_ERR_ARG;
+
+    return Convert (ctx, NULL);
+}
+
+/*______________________________________________________________________________
+ Desc:  Convert a png image held in memory, the file names of the context are
+        not used and the filesystem is never accessed.
+ Arg: - <ctx>[in] the context.
+        <png>[in] png file bytes.
+        <pngSize>[in] png file size.
+        <out>[in/out] destination buffer of *<outSize> bytes. When *<out> is
+                      NULL a buffer is allocated with malloc and returned here,
+                      the caller releases it with free.
+        <outSize>[in/out] size of the destination buffer, set to the raw image
+                          size (also when the given buffer is too small).
+ Ret: - IMGCVT_OK on success, IMGCVT_ERR_ARG if an argument is not valid.
+______________________________________________________________________________*/
+imgcvt_Result_e imgcvt_ConvertMemory (const imgcvt_Ctx_t *ctx, const uint8_t *png, size_t pngSize, uint8_t **out, size_t *outSize)
+{
+    if (ctx == NULL || png == NULL || out == NULL || outSize == NULL ||
+        ctx->clr_format < 0 || ctx->clr_format >= (int8_t)L_NELEMENTS (PxlFormatTable) ||
+        ctx->ori < 0 || ctx->ori >= (int8_t)L_NELEMENTS (TraversePixelTable) ||
+        ctx->kernel < -1 || ctx->kernel > (int8_t)DetectKernel ( ))
+        return IMGCVT_ERR_ARG;
+
+    return ConvertMemory (ctx, png, pngSize, out, outSize);
+}
+
+/*______________________________________________________________________________
+ Desc:  Convert an image file.
+ Arg: - <inF>[in] input png file path.
+        <outF>[in] output raw file path.
+        <clrFormat>[in] output color format.
+        <ori>[in] output orientation.
+ Ret: - IMGCVT_OK on success.
+______________________________________________________________________________*/
 imgcvt_Result_e imgcvt_Convert (const char *inF, const char *outF, int8_t clrFormat, int8_t ori)
 {
-    ArgIn_FnameImg = inF;
-    ArgIn_FnameOut = outF;
-    ArgIn_ClrFomat = clrFormat;
-    ArgIn_Ori = ori;
-    WritePxl = PxlFormatTable[ArgIn_ClrFomat].func_write;
-    TraversePixel = TraversePixelTable[ArgIn_Ori];
-    
-    return Convert ( );
+    imgcvt_Ctx_t ctx;
+
+    imgcvt_CtxInit (&ctx);
+    ctx.in_fname = inF;
+    ctx.out_fname = outF;
+    ctx.clr_format = clrFormat;
+    ctx.ori = ori;
+    return imgcvt_CtxConvert (&ctx);
 }
 
 //_____________________________________________________________PRIVATE FUNCTIONS
 
-#if !defined(IMGCVT_MCU)
+/* IMGCVT_NO_MAIN builds only the library, for programs linking it (like the benchmark) */
+#if !defined(IMGCVT_MCU) && !defined(IMGCVT_NO_MAIN)
 /* Application entry point.
     Args:
 - <argc>[in] command line argument's number.
@@ -137,9 +594,39 @@ int main (int argc, char *argv[])
     int c; /* option identifier character */
     /* flag meaning all provided arguments are ok */
     bool argsOk = true;
+    /* conversion options */
+    imgcvt_Ctx_t ctx;
+    /* number of worker threads */
+    unsigned nThreads = 1;
+    /* true when -o is a directory receiving one raw file per input */
+    bool outDir = false;
+    /* manifest file listing the jobs, NULL when the jobs come from the command line */
+    const char *manifest = NULL;
+    /* print the time of every conversion phase */
+    bool stats = false;
+
+    imgcvt_CtxInit (&ctx);
+
+    /* options without a short form */
+    enum
+    {
+        OPT_KERNEL = 256,
+        OPT_CACHE,
+        OPT_STATS,
+        OPT_NO_CRC,
+    };
+    const struct option longOptions[] =
+    {
+        { "kernel", required_argument, NULL, OPT_KERNEL },
+        { "manifest", required_argument, NULL, 'm' },
+        { "cache", required_argument, NULL, OPT_CACHE },
+        { "stats", no_argument, NULL, OPT_STATS },
+        { "no-crc", no_argument, NULL, OPT_NO_CRC },
+        { NULL, 0, NULL, 0 },
+    };
 
     /* parse command line options */
-    while ((c = getopt (argc, argv, ":o:f:r:h")) != -1)
+    while ((c = getopt_long (argc, argv, ":o:f:r:j:m:h", longOptions, NULL)) != -1)
     {
         switch (c)
         {
@@ -153,23 +640,15 @@ int main (int argc, char *argv[])
             /* output destination */
             case 'o':
             {
-                ArgIn_FnameOut = optarg;
+                ctx.out_fname = optarg;
                 break;
             }
 
             /* specify output format */
             case 'f':
             {
-                ArgIn_ClrFomat = -1;
-                for (int i = 0; i < L_NELEMENTS (PxlFormatTable); i++)
-                {
-                    if (strcmp (optarg, PxlFormatTable[i].name) == 0)
-                        ArgIn_ClrFomat = i;
-                }
-                
-                if (ArgIn_ClrFomat != -1) // get the corresponding put function
-                    WritePxl = PxlFormatTable[ArgIn_ClrFomat].func_write;
-                else
+                ctx.clr_format = ParseClrFormat (optarg);
+                if (ctx.clr_format == -1)
                 {
                     argsOk = false;
                     fprintf (stderr, "%s is not a valid color format\n", optarg);
@@ -180,22 +659,8 @@ int main (int argc, char *argv[])
             /* specify image rotation */
             case 'r':
             {
-                int rotation;
-
-                ArgIn_Ori = -1;
-                rotation = atoi (optarg);
-                if (rotation == 0)
-                    ArgIn_Ori = IMGCVT_ORI_0;
-                else if (rotation == 90)
-                    ArgIn_Ori = IMGCVT_ORI_90;
-                else if (rotation == 180)
-                    ArgIn_Ori = IMGCVT_ORI_180;
-                else if (rotation == 270)
-                    ArgIn_Ori = IMGCVT_ORI_270;
-                
-                if (ArgIn_Ori != -1) // get the corresponding pixel traversal function
-                    TraversePixel = TraversePixelTable[ArgIn_Ori];
-                else
+                ctx.ori = ParseOri (optarg);
+                if (ctx.ori == -1)
                 {
                     argsOk = false;
                     fprintf (stderr, "%s is not a valid rotation\n", optarg);
@@ -203,11 +668,89 @@ int main (int argc, char *argv[])
                 break;
             }
 
+            /* manifest file with one job per line */
+            case 'm':
+            {
+                manifest = optarg;
+                break;
+            }
+
+            /* number of worker threads */
+            case 'j':
+            {
+                char *end;
+                unsigned long n = strtoul (optarg, &end, 10);
+
+                /* strtoul takes -1 as a huge number, it is rejected with the others */
+                if (end != optarg && *end == '\0' && n > 0 && n <= L_MAX_THREADS)
+                    nThreads = (unsigned)n;
+                else
+                {
+                    argsOk = false;
+                    fprintf (stderr, "%s is not a valid number of threads, from 1 to %d\n", optarg, L_MAX_THREADS);
+                }
+                break;
+            }
+
+            /* force a conversion kernel variant */
+            case OPT_KERNEL:
+            {
+                ctx.kernel = -1;
+                for (size_t i = 0; i < L_NELEMENTS (KernelNameTable); i++)
+                {
+                    if (strcmp (optarg, KernelNameTable[i]) == 0)
+                        ctx.kernel = i;
+                }
+
+                if (ctx.kernel == -1)
+                {
+                    argsOk = false;
+                    fprintf (stderr, "%s is not a valid kernel\n", optarg);
+                }
+                else if (ctx.kernel > (int8_t)DetectKernel ( ))
+                {
+                    argsOk = false;
+                    fprintf (stderr, "%s kernels are not supported by this cpu\n", optarg);
+                }
+                break;
+            }
+
+            /* conversion cache directory */
+            case OPT_CACHE:
+            {
+                ctx.cache_dir = optarg;
+                if (mkdir (optarg, 0777) != 0 && errno != EEXIST)
+                {
+                    argsOk = false;
+                    fprintf (stderr, "i can't create the cache directory %s\n", optarg);
+                }
+                break;
+            }
+
+            /* per phase timing */
+            case OPT_STATS:
+            {
+#if defined(L_STATS)
+                stats = true;
+#else
+                argsOk = false;
+                fprintf (stderr, "--stats is not supported by this build, compile it with IMGCVT_STATS\n");
+#endif
+                break;
+            }
+
+            /* trusted inputs: skip the chunk CRC checks */
+            case OPT_NO_CRC:
+            {
+                ctx.ignore_crc = true;
+                break;
+            }
+
             /* missing option argument */
             case ':':
             {
                 argsOk = false;
-                fprintf (stderr, "missing option argument for -%c option\n", optopt);
+                fprintf (stderr, "missing option argument for %s option\n", argv[optind - 1]);
                 break;
             }
             
@@ -215,37 +758,151 @@ int main (int argc, char *argv[])
             default: /* '?' */
             {
                 argsOk = false;
-                fprintf (stderr, "-%c is not a valid option\n", optopt);
+                if (optopt != 0)
+                    fprintf (stderr, "-%c is not a valid option\n", optopt);
+                else
+                    fprintf (stderr, "%s is not a valid option\n", argv[optind - 1]);
                 break;
             }
         }
     }
 
-    /* the user most provide the input image file */
-    if (optind == argc -1)
+    if (manifest != NULL)
+    {   /* every job is described by the manifest */
+        if (optind < argc || ctx.out_fname != NULL)
+        {
+            argsOk = false;
+            fprintf (stderr, "-m can't be used together with input image files or -o\n");
+        }
+    }
+    /* the user most provide at least one input image file */
+    else if (optind < argc)
     {   /* we get the input image file name */
-        ArgIn_FnameImg = argv[optind];
+        ctx.in_fname = argv[optind];
     }
     else
-    {   /* the user provided not even one or more than one input file name */
+    {   /* the user provided not even one input file name */
         argsOk = false;
-        fprintf (stderr, "you must porvide at least one and only one input image file\n");
+        fprintf (stderr, "you must porvide at least one input image file\n");
     }
 
-    if (ArgIn_FnameOut == NULL)
+    if (manifest == NULL && ctx.out_fname == NULL)
     {
         argsOk = false;
         fprintf (stderr, "-o with specified output destination is mandatory\n");
     }
+    else if (manifest == NULL)
+    {   /* more inputs or a directory destination: write one raw file per input inside it */
+        struct stat st;
+        size_t len = strlen (ctx.out_fname);
+
+        outDir = (argc - optind > 1) || (len > 0 && ctx.out_fname[len - 1] == '/') ||
+                 (stat (ctx.out_fname, &st) == 0 && S_ISDIR (st.st_mode));
+    }
+
+    if (!argsOk)
+        return 1;
+
+    if (manifest == NULL && !outDir)
+    {
+        imgcvt_Stats_t st = { 0 };
+        imgcvt_Result_e result;
+
+        ctx.stats = stats ? &st : NULL;
+        ctx.threads = nThreads;
+        result = Convert (&ctx, NULL);
+        if (stats && result == IMGCVT_OK)
+            PrintStats (ctx.in_fname, &st);
+        return result == IMGCVT_OK ? 0 : 1;
+    }
+
+    /* batch conversion */
+    size_t num = 0;
+    size_t failed;
+    imgcvt_Ctx_t *jobs = NULL;
+    imgcvt_Stats_t *jobStats = NULL;
+
+    if (manifest != NULL)
+    {
+        if (LoadManifest (manifest, &ctx, &jobs, &num) != IMGCVT_OK)
+            return 1;
+    }
+    else
+    {
+        num = argc - optind;
+        jobs = calloc (num, sizeof (*jobs));
+        if (jobs == NULL)
+        {
+            L_PRINT_GEN_ERR;
+            return 1;
+        }
+        for (size_t i = 0; i < num; i++)
+        {
+            jobs[i] = ctx;
+            jobs[i].in_fname = strdup (argv[optind + i]);
+            jobs[i].out_fname = MakeOutFname (ctx.out_fname, argv[optind + i]);
+            if (jobs[i].in_fname == NULL || jobs[i].out_fname == NULL)
+            {
+                L_PRINT_GEN_ERR;
+                FreeJobs (jobs, num);
+                return 1;
+            }
+        }
+    }
+
+    if (CheckOutFnames (jobs, num) != IMGCVT_OK)
+    {
+        FreeJobs (jobs, num);
+        return 1;
+    }
+
+    for (size_t i = 0; i < num; i++)
+    {   /* threads left over by the batch workers convert bands of the images */
+        jobs[i].threads = nThreads > num ? nThreads / num : 1;
+    }
+
+    if (stats)
+    {   /* every job times its own conversion */
+        jobStats = calloc (num, sizeof (*jobStats));
+        if (jobStats == NULL)
+        {
+            L_PRINT_GEN_ERR;
+            FreeJobs (jobs, num);
+            return 1;
+        }
+        for (size_t i = 0; i < num; i++)
+            jobs[i].stats = &jobStats[i];
+    }
+
+    failed = RunBatch (jobs, num, nThreads);
+
+    if (stats)
+    {   /* in job order whatever the thread that converted it, then the sum of all */
+        imgcvt_Stats_t total = { 0 };
+
+        for (size_t i = 0; i < num; i++)
+        {
+            PrintStats (jobs[i].in_fname, &jobStats[i]);
+            for (int p = 0; p < IMGCVT_PHASE_NUM; p++)
+            {
+                total.seconds[p] += jobStats[i].seconds[p];
+                total.bytes[p] += jobStats[i].bytes[p];
+            }
+        }
+        PrintStats ("total", &total);
+    }
+    FreeJobs (jobs, num);
+    free (jobStats);
 
-    if (argsOk)
-        Convert ( );
+    if (failed > 0)
+        fprintf (stderr, "%zu of %zu images failed\n", failed, num);
+    return failed > 0 ? 1 : 0;
 }
 #endif
 
 //_____________________________________________________________PRIVATE FUNCTIONS
 
-#if !defined(IMGCVT_MCU)
+#if !defined(IMGCVT_MCU) && !defined(IMGCVT_NO_MAIN)
 /* Print help using the command line arguments.
     Args:
     Ret:
@@ -255,7 +912,9 @@ static void PrintHelp (void)
     printf ("\n");
     printf ("\
 imgcvt use:\n\
-    fontcvt [OPTIONS] ... IMAGE_FILE -o OUTPUT_NAME\n");
+    imgcvt [OPTIONS] ... IMAGE_FILE -o OUTPUT_NAME\n\
+    imgcvt [OPTIONS] ... IMAGE_FILE... -o OUTPUT_DIR/\n\
+    imgcvt [OPTIONS] ... -m MANIFEST_FILE\n");
     printf ("\n");
     printf ("\
 -f) Output color format. (default argb8888).\n");
@@ -263,352 +922,2993 @@ imgcvt use:\n\
 -r) Output image rotation. (default 0). Valid options are:\n\
     (  0) ( 90) (180) (270)\n");
     printf ("\
--o) Specify the output filename. (mandatory)\n");
+-o) Specify the output filename. (mandatory)\n\
+    With more input images, or when it is a directory, every image is\n\
+    converted to OUTPUT_DIR/<image name>.raw, two images with the same\n\
+    name are an error.\n");
+    printf ("\
+-m) Convert the jobs listed in a manifest file, one per line:\n\
+        IMAGE_FILE OUTPUT_NAME [-f FORMAT] [-r ROTATION]\n\
+    Empty lines and lines starting with # are skipped. -f, -r and --kernel\n\
+    given on the command line are the defaults of every job.\n");
+    printf ("\
+-j) Number of threads, up to 1024. (default 1)\n\
+    Images are converted in parallel, the threads left over convert the\n\
+    pixels of large images in bands of rows.\n");
+    printf ("\
+--kernel) Force a conversion kernel variant. (default: best supported by the cpu)\n\
+    (scalar) (sse2) (ssse3) (avx2) (avx512)\n");
+    printf ("\
+--cache) Keep the converted images in this directory. An image already converted\n\
+    with the same png file, format and rotation is copied from there instead\n\
+    of being decoded again.\n");
+    printf ("\
+--stats) Print the time and output bytes of every conversion phase of every\n\
+    image: load, parse, inflate, unfilter, rgba, pixels, write.\n");
+    printf ("\
+--no-crc) Do not check the CRC of the png chunks, for trusted input images.\n");
     printf ("\
 -h) Print this help and exit.\n");
 }
-#endif
 
-/* Main program function, called after all input oprions are parsed.
-    Args:
-    Ret:
+/* Build the output file name of an input image in batch mode.
+    Args: <outDir>[in] output directory.
+          <inFname>[in] input image path.
+    Ret: <outDir>/<input name without extension>.raw, allocated with malloc.
 */
-static imgcvt_Result_e Convert (void)
+static char *MakeOutFname (const char *outDir, const char *inFname)
 {
-    uint32_t error;
-    uint8_t* image = 0;
-    uint32_t width, height;
-    imgcvt_Result_e result = IMGCVT_OK;
-
-    error = lodepng_decode32_file(&image, &width, &height, ArgIn_FnameImg);
-    if(error)
-        printf("error %u: %s\n", error, lodepng_error_text(error));
-    else
+    const char *name = strrchr (inFname, '/');
+    const char *ext;
+    size_t dirLen = strlen (outDir);
+    size_t nameLen;
+    char *out;
+
+    name = name != NULL ? name + 1 : inFname;
+    ext = strrchr (name, '.');
+    nameLen = ext != NULL && ext != name ? (size_t)(ext - name) : strlen (name);
+
+    out = malloc (dirLen + 1 + nameLen + sizeof (".raw"));
+    if (out != NULL)
     {
-        /*use image here*/
-        FILE *f = fopen (ArgIn_FnameOut, "wb");
-        if (f == NULL) {
-            printf ("i can't open the output file\n");
-            result = IMGCVT_ERR;
-        }
-        else
-        {
-            uint8_t beWidth[4]; // big endian width
-            uint8_t beHeigth[4]; // big endian height
-            uint8_t bePxlOffset[4]; // big pixel offset
-            uint8_t clrFormat; // output image color format
-            uint8_t ori; // output image orientation
-
-            clrFormat = ArgIn_ClrFomat;
-            ori = ArgIn_Ori;
-            GetBeInt32t (beWidth, width);
-            GetBeInt32t (beHeigth, height);
-            GetBeInt32t (bePxlOffset, 32);
-
-            /* print simple file header */
-            for (;;)
-            {
-                if (fprintf (f, "RAW") != 3) {
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                if (fprintf (f, "v01") != 3) {
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                if (Fwrite (&ori, sizeof (ori), f) != IMGCVT_OK) {
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                
-                if (Fwrite (&clrFormat, sizeof (clrFormat), f) != IMGCVT_OK) {
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                if (Fwrite (beWidth, sizeof (beWidth), f) != IMGCVT_OK) { // width
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                if (Fwrite (beHeigth, sizeof (beHeigth), f) != IMGCVT_OK) { // height
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                if (Fwrite (bePxlOffset, sizeof (bePxlOffset), f) != IMGCVT_OK) { // height
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                if (fprintf (f, "------------") != 12) { // to reach 32 chars (12 = 32 - 20)
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                
-                /* print image pixels */
-                if (TraversePixel (f, image, width, height, WritePxl)) {
-                    result = IMGCVT_ERR;
-                    break;
-                }
-                break;
-            }
-            fclose (f);
-        }
+        memcpy (out, outDir, dirLen);
+        if (dirLen > 0 && outDir[dirLen - 1] != '/')
+            out[dirLen++] = '/';
+        memcpy (&out[dirLen], name, nameLen);
+        strcpy (&out[dirLen + nameLen], ".raw");
     }
-
-#ifdef LODEPNG_COMPILE_ALLOCATORS
-    free(image);
-#else
-    lodepng_free(image);
-#endif
-    return result;
+    return out;
 }
 
-/* Write to a file and returns 0 on success.
-    Args: <ptr>[in] what to write.
-          <size>[in] size in bytes.
-          <stream>[in] the file stream.
-    Ret:
+/* Find a color format by name.
+    Args: <name>[in] color format name, as accepted by -f.
+    Ret: the IMGCVT_CLR_FORMAT_ value, -1 if the name is not valid.
 */
-static imgcvt_Result_e Fwrite (void *ptr, size_t size, FILE *stream)
+static int8_t ParseClrFormat (const char *name)
 {
-    if (fwrite (ptr, 1, size, stream) != size)
-        return IMGCVT_ERR;
-    return IMGCVT_OK;
+    for (size_t i = 0; i < L_NELEMENTS (PxlFormatTable); i++)
+    {
+        if (strcmp (name, PxlFormatTable[i].name) == 0)
+            return i;
+    }
+    return -1;
 }
 
-/* Get big endian 32bit number rappresentation.
-    Args: <leVal>[out] little endian number rappresentation.
-          <val>[in] value to get le rappresentation.
-    Ret:
+/* Find an orientation by rotation degrees.
+    Args: <degrees>[in] rotation, as accepted by -r.
+    Ret: the IMGCVT_ORI_ value, -1 if the rotation is not valid.
 */
-static void GetBeInt32t (uint8_t *leVal, int32_t val)
+static int8_t ParseOri (const char *degrees)
 {
-    leVal[3] = (val >>  0) & 0xff;
-    leVal[2] = (val >>  8) & 0xff;
-    leVal[1] = (val >> 16) & 0xff;
-    leVal[0] = (val >> 24) & 0xff;
+    char *end;
+    long rotation = strtol (degrees, &end, 10);
+
+    if (end == degrees || *end != '\0')
+        return -1; // not a number, or trailing characters like 90x
+    if (rotation == 0)
+        return IMGCVT_ORI_0;
+    else if (rotation == 90)
+        return IMGCVT_ORI_90;
+    else if (rotation == 180)
+        return IMGCVT_ORI_180;
+    else if (rotation == 270)
+        return IMGCVT_ORI_270;
+    return -1;
 }
 
-/* Write all image pixel to file.
-    Args: <f>[in] append all pixel to the file.
-          <img>[in] RGBA8888 pixel map.
-          <w>[in] image width.
-          <h>[in] image height.
-          <wrPxl>[in] function used to write pixel in file.
-    Ret:
+/* Read the jobs of a manifest file. Every problem found is reported and no
+   job is returned if the manifest is not completely valid.
+    Args: <fname>[in] manifest file path.
+          <defaults>[in] options of the jobs not set by their line.
+          <jobs>[out] jobs allocated with malloc, released with FreeJobs.
+          <num>[out] number of jobs.
+    Ret: IMGCVT_OK on success.
 */
-static imgcvt_Result_e TraversePixelOri0 (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl)
+static imgcvt_Result_e LoadManifest (const char *fname, const imgcvt_Ctx_t *defaults, imgcvt_Ctx_t **jobs, size_t *num)
 {
-    for (int y = 0; y < h; y++)
+    imgcvt_Result_e result = IMGCVT_OK;
+    char line[L_MANIFEST_LINE];
+    unsigned lineNum = 0;
+    size_t size = 0;
+    FILE *f;
+
+    *jobs = NULL;
+    *num = 0;
+    f = fopen (fname, "r");
+    if (f == NULL)
     {
-        for (int x = 0; x < w; x++)
-        {
-            uint8_t *inClr;
-
-            inClr = &img[(x + y * w) * 4];
-            if (wrPxl (f, inClr) != IMGCVT_OK) {
-                return IMGCVT_ERR;
-            }
-        }
+        fprintf (stderr, "i can't open the manifest file %s\n", fname);
+        return IMGCVT_ERR;
     }
-    return IMGCVT_OK;
-}
 
-/* Write all image pixel to file.
-    Args: <f>[in] append all pixel to the file.
-          <img>[in] RGBA8888 pixel map.
-          <w>[in] image width.
-          <h>[in] image height.
-          <wrPxl>[in] function used to write pixel in file.
-    Ret:
-*/
-static imgcvt_Result_e TraversePixelOri90 (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl)
-{
-    for (int x = w - 1; x >= 0; x--)
+    while (fgets (line, sizeof (line), f) != NULL)
     {
-        for (int y = 0; y < h; y++)
-        {
-            uint8_t *inClr;
+        imgcvt_Ctx_t job = *defaults;
+        char *first;
 
-            inClr = &img[(x + y * w) * 4];
-            if (wrPxl (f, inClr) != IMGCVT_OK) {
-                return IMGCVT_ERR;
-            }
+        lineNum++;
+        if (strchr (line, '\n') == NULL && !feof (f))
+        {
+            fprintf (stderr, "%s:%u: line too long\n", fname, lineNum);
+            result = IMGCVT_ERR;
+            break;
         }
-    }
-    return IMGCVT_OK;
-}
 
-/* Write all image pixel to file.
-    Args: <f>[in] append all pixel to the file.
+        first = line + strspn (line, " \t\r\n");
+        if (*first == '\0' || *first == '#')
+            continue;
+        if (ParseManifestLine (first, &job) != IMGCVT_OK)
+        {
+            fprintf (stderr, "%s:%u: not a valid job\n", fname, lineNum);
+            result = IMGCVT_ERR;
+            continue;
+        }
+
+        if (*num == size)
+        {
+            size_t newSize = size > 0 ? size * 2 : 64;
+            imgcvt_Ctx_t *newJobs = realloc (*jobs, newSize * sizeof (**jobs));
+
+            if (newJobs == NULL)
+            {
+                L_PRINT_GEN_ERR;
+                result = IMGCVT_ERR;
+                break;
+            }
+            *jobs = newJobs;
+            size = newSize;
+        }
+        job.in_fname = strdup (job.in_fname);
+        job.out_fname = strdup (job.out_fname);
+        (*jobs)[(*num)++] = job;
+        if (job.in_fname == NULL || job.out_fname == NULL)
+        {
+            L_PRINT_GEN_ERR;
+            result = IMGCVT_ERR;
+            break;
+        }
+    }
+
+    if (ferror (f))
+    {
+        fprintf (stderr, "i can't read the manifest file %s\n", fname);
+        result = IMGCVT_ERR;
+    }
+    fclose (f);
+
+    if (result == IMGCVT_OK && *num == 0)
+    {
+        fprintf (stderr, "%s: the manifest has no jobs\n", fname);
+        result = IMGCVT_ERR;
+    }
+    if (result != IMGCVT_OK)
+    {
+        FreeJobs (*jobs, *num);
+        *jobs = NULL;
+        *num = 0;
+    }
+    return result;
+}
+
+/* Parse a manifest line: IMAGE_FILE OUTPUT_NAME [-f FORMAT] [-r ROTATION].
+   Only the exact tokens -f and -r are options, their value is the next
+   token: any other token is a file name, even if it starts with -f or -r.
+    Args: <line>[in/out] the line, split in place.
+          <job>[in/out] the job, its file names point inside <line>.
+    Ret: IMGCVT_OK if the line is valid.
+*/
+static imgcvt_Result_e ParseManifestLine (char *line, imgcvt_Ctx_t *job)
+{
+    const char *const sep = " \t\r\n";
+    char *save;
+    char *tok;
+    unsigned nNames = 0;
+
+    for (tok = strtok_r (line, sep, &save); tok != NULL; tok = strtok_r (NULL, sep, &save))
+    {
+        if (strcmp (tok, "-f") == 0 || strcmp (tok, "-r") == 0)
+        {
+            const char *val = strtok_r (NULL, sep, &save);
+
+            if (val == NULL)
+                return IMGCVT_ERR;
+            if (tok[1] == 'f')
+            {
+                job->clr_format = ParseClrFormat (val);
+                if (job->clr_format == -1)
+                    return IMGCVT_ERR;
+            }
+            else
+            {
+                job->ori = ParseOri (val);
+                if (job->ori == -1)
+                    return IMGCVT_ERR;
+            }
+        }
+        else if (nNames == 0)
+        {
+            job->in_fname = tok;
+            nNames++;
+        }
+        else if (nNames == 1)
+        {
+            job->out_fname = tok;
+            nNames++;
+        }
+        else
+            return IMGCVT_ERR;
+    }
+    return nNames == 2 ? IMGCVT_OK : IMGCVT_ERR;
+}
+
+/* Release batch jobs and their file names.
+    Args: <jobs>[in] jobs allocated with malloc, may be NULL.
+          <num>[in] number of jobs.
+    Ret:
+*/
+static void FreeJobs (imgcvt_Ctx_t *jobs, size_t num)
+{
+    for (size_t i = 0; jobs != NULL && i < num; i++)
+    {
+        free ((char *)jobs[i].in_fname);
+        free ((char *)jobs[i].out_fname);
+    }
+    free (jobs);
+}
+
+/* qsort comparison of two jobs by output file name.
+    Args: <a>[in] pointer to the first job pointer.
+          <b>[in] pointer to the second job pointer.
+    Ret: <0, 0 or >0 like strcmp.
+*/
+static int CmpOutFname (const void *a, const void *b)
+{
+    const imgcvt_Ctx_t *jobA = *(const imgcvt_Ctx_t *const *)a;
+    const imgcvt_Ctx_t *jobB = *(const imgcvt_Ctx_t *const *)b;
+
+    return strcmp (jobA->out_fname, jobB->out_fname);
+}
+
+/* Check that no two batch jobs write the same output file: they would
+   overwrite each other, or even write the same file at the same time.
+   Every clash is reported.
+    Args: <jobs>[in] the jobs.
+          <num>[in] number of jobs.
+    Ret: IMGCVT_OK if every job has its own output file.
+*/
+static imgcvt_Result_e CheckOutFnames (const imgcvt_Ctx_t *jobs, size_t num)
+{
+    imgcvt_Result_e result = IMGCVT_OK;
+    const imgcvt_Ctx_t **sorted = malloc (num * sizeof (*sorted));
+
+    if (sorted == NULL)
+    {
+        L_PRINT_GEN_ERR;
+        return IMGCVT_ERR;
+    }
+    for (size_t i = 0; i < num; i++)
+        sorted[i] = &jobs[i];
+    qsort (sorted, num, sizeof (*sorted), CmpOutFname);
+
+    for (size_t i = 1; i < num; i++)
+    {
+        if (strcmp (sorted[i - 1]->out_fname, sorted[i]->out_fname) == 0)
+        {
+            fprintf (stderr, "%s and %s are both converted to %s\n",
+                     sorted[i - 1]->in_fname, sorted[i]->in_fname, sorted[i]->out_fname);
+            result = IMGCVT_ERR;
+        }
+    }
+    free (sorted);
+    return result;
+}
+
+/* Take the next job from the front of a worker queue.
+    Args: <q>[in/out] the queue.
+          <job>[out] index of the job.
+    Ret: false if the queue is empty.
+*/
+static bool PopJob (WorkQueue_t *q, size_t *job)
+{
+    bool found = false;
+
+    pthread_mutex_lock (&q->lock);
+    if (q->head < q->tail)
+    {
+        *job = q->head++;
+        found = true;
+    }
+    pthread_mutex_unlock (&q->lock);
+    return found;
+}
+
+/* Move the back half of the first non empty queue of another worker into the
+   (empty) queue of a worker.
+    Args: <batch>[in/out] the batch.
+          <id>[in] the idle worker.
+    Ret: false if every other queue is empty, there is nothing left to do.
+*/
+static bool StealJobs (Batch_t *batch, unsigned id)
+{
+    for (unsigned i = 1; i < batch->nWorkers; i++)
+    {
+        WorkQueue_t *victim = &batch->queues[(id + i) % batch->nWorkers];
+        WorkQueue_t *own = &batch->queues[id];
+        size_t head = 0, tail = 0;
+
+        pthread_mutex_lock (&victim->lock);
+        if (victim->head < victim->tail)
+        {
+            tail = victim->tail;
+            head = tail - (tail - victim->head + 1) / 2;
+            victim->tail = head;
+        }
+        pthread_mutex_unlock (&victim->lock);
+
+        if (head < tail)
+        {
+            pthread_mutex_lock (&own->lock);
+            own->head = head;
+            own->tail = tail;
+            pthread_mutex_unlock (&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Batch worker thread: convert the images of its own queue, then steal from
+   the others until every queue is empty.
+    Args: <arg>[in] the Worker_t of the thread.
+    Ret: NULL.
+*/
+static void *BatchWorker (void *arg)
+{
+    Worker_t *worker = arg;
+    Batch_t *batch = worker->batch;
+    Decoder_t decoder;
+    Decoder_t *dec = DecoderInit (&decoder) == IMGCVT_OK ? &decoder : NULL;
+    size_t i;
+
+    for (;;)
+    {
+        if (!PopJob (&batch->queues[worker->id], &i))
+        {
+            if (!StealJobs (batch, worker->id))
+                break;
+            continue;
+        }
+
+        if (Convert (&batch->jobs[i], dec) != IMGCVT_OK)
+        {
+            fprintf (stderr, "%s: conversion failed\n", batch->jobs[i].in_fname);
+            pthread_mutex_lock (&batch->lock);
+            batch->failed++;
+            pthread_mutex_unlock (&batch->lock);
+        }
+    }
+    if (dec != NULL)
+        DecoderCleanup (dec);
+    return NULL;
+}
+
+/* Convert many images with a pool of worker threads. The jobs are split in
+   equal ranges, one per worker, and rebalanced by work stealing.
+    Args: <jobs>[in] one conversion context per image.
+          <num>[in] number of images.
+          <nThreads>[in] number of worker threads.
+    Ret: number of images that failed.
+*/
+static size_t RunBatch (imgcvt_Ctx_t *jobs, size_t num, unsigned nThreads)
+{
+    Batch_t batch;
+    pthread_t *threads;
+    Worker_t *workers;
+    unsigned started = 0;
+
+    if (nThreads > num)
+        nThreads = num;
+    if (nThreads == 0)
+        nThreads = 1;
+
+    batch.jobs = jobs;
+    batch.num = num;
+    batch.failed = 0;
+    batch.queues = malloc (nThreads * sizeof (*batch.queues));
+    workers = malloc (nThreads * sizeof (*workers));
+    if (batch.queues == NULL || workers == NULL)
+    {
+        L_PRINT_GEN_ERR;
+        free (batch.queues);
+        free (workers);
+        return num;
+    }
+    batch.nWorkers = nThreads;
+    pthread_mutex_init (&batch.lock, NULL);
+    for (unsigned i = 0; i < nThreads; i++)
+    {
+        batch.queues[i].head = num * i / nThreads;
+        batch.queues[i].tail = num * (i + 1) / nThreads;
+        pthread_mutex_init (&batch.queues[i].lock, NULL);
+        workers[i].batch = &batch;
+        workers[i].id = i;
+    }
+
+    /* the calling thread is worker 0, the queues of workers that fail to start are stolen */
+    threads = malloc (nThreads * sizeof (*threads));
+    if (threads != NULL)
+    {
+        for (; started + 1 < nThreads; started++)
+        {
+            if (pthread_create (&threads[started], NULL, BatchWorker, &workers[started + 1]) != 0)
+                break;
+        }
+    }
+    BatchWorker (&workers[0]);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join (threads[i], NULL);
+
+    for (unsigned i = 0; i < nThreads; i++)
+        pthread_mutex_destroy (&batch.queues[i].lock);
+    pthread_mutex_destroy (&batch.lock);
+    free (batch.queues);
+    free (threads);
+    free (workers);
+    return batch.failed;
+}
+#endif
+
+#if !defined(IMGCVT_MCU)
+/* Build the conversion cache entry of an image. The header holds the whole
+   key of the conversion: the SHA-256 and size of the png bytes, the output
+   options and the converter build. The entry is named after the SHA-256 of
+   its header and holds the header followed by the raw image.
+    Args: <entry>[out] the entry, release its path with free.
+          <ctx>[in] conversion options.
+          <png>[in] png file bytes.
+          <pngSize>[in] png file size.
+    Ret: IMGCVT_OK on success.
+*/
+static imgcvt_Result_e CacheEntryInit (CacheEntry_t *entry, const imgcvt_Ctx_t *ctx, const uint8_t *png, size_t pngSize)
+{
+    uint8_t *hdr = entry->hdr;
+    uint8_t name[32];
+    size_t len = strlen (ctx->cache_dir) + 2 * sizeof (name) + sizeof ("/.raw");
+    Sha256_t sha;
+    LodePNGState local;
+    LodePNGState *state;
+    unsigned width, height;
+    unsigned error;
+
+    state = DecoderAcquire (ctx, NULL, &local);
+    error = lodepng_inspect (&width, &height, state, png, pngSize);
+    DecoderRelease (NULL, state);
+    if (error)
+        return IMGCVT_ERR;
+    entry->rawSize = L_HEADER_SIZE + (size_t)width * height * PxlFormatTable[ctx->clr_format].bytes_pxl;
+
+    memset (hdr, 0, L_CACHE_HDR_SIZE);
+    memcpy (&hdr[0], L_CACHE_MAGIC, 8);
+    Sha256Init (&sha);
+    Sha256Update (&sha, png, pngSize);
+    Sha256Final (&sha, &hdr[8]);
+    for (int i = 0; i < 8; i++)
+        hdr[40 + i] = (uint8_t)((uint64_t)pngSize >> (56 - 8 * i));
+    hdr[48] = (uint8_t)ctx->clr_format;
+    hdr[49] = (uint8_t)ctx->ori;
+    snprintf ((char *)&hdr[64], L_CACHE_HDR_SIZE - 64, "%s", L_BUILD_ID);
+
+    Sha256Init (&sha);
+    Sha256Update (&sha, hdr, L_CACHE_HDR_SIZE);
+    Sha256Final (&sha, name);
+
+    entry->path = malloc (len);
+    if (entry->path == NULL)
+        return IMGCVT_ERR;
+    int n = snprintf (entry->path, len, "%s/", ctx->cache_dir);
+    for (size_t i = 0; i < sizeof (name); i++)
+        n += snprintf (&entry->path[n], len - n, "%02x", name[i]);
+    snprintf (&entry->path[n], len - n, ".raw");
+    return IMGCVT_OK;
+}
+
+/* Copy the rest of a stream into another one.
+    Args: <src>[in] source stream.
+          <dst>[in] destination stream.
+    Ret: IMGCVT_OK on success.
+*/
+static imgcvt_Result_e CopyFile (FILE *src, FILE *dst)
+{
+    imgcvt_Result_e result = IMGCVT_OK;
+    uint8_t *buf;
+    size_t n;
+
+    buf = malloc (L_OUT_BUF_SIZE);
+    if (buf == NULL)
+        return IMGCVT_ERR;
+
+    while (result == IMGCVT_OK && (n = fread (buf, 1, L_OUT_BUF_SIZE, src)) > 0)
+        result = Fwrite (buf, n, dst);
+    if (ferror (src))
+        result = IMGCVT_ERR;
+
+    free (buf);
+    return result;
+}
+
+/* Write the output of a conversion from its cache entry. The entry is used
+   only if its header is the expected one, byte for byte. An entry of the
+   wrong size is corrupt and removed.
+    Args: <entry>[in] the cache entry.
+          <outFname>[in] output raw file path.
+    Ret: IMGCVT_OK on a cache hit, the output file is written.
+*/
+static imgcvt_Result_e CacheLoad (const CacheEntry_t *entry, const char *outFname)
+{
+    imgcvt_Result_e result;
+    uint8_t hdr[L_CACHE_HDR_SIZE];
+    struct stat st;
+    FILE *f;
+    FILE *out;
+
+    f = fopen (entry->path, "rb");
+    if (f == NULL)
+        return IMGCVT_ERR;
+    if (fread (hdr, 1, sizeof (hdr), f) != sizeof (hdr) || memcmp (hdr, entry->hdr, sizeof (hdr)) != 0)
+    {   /* another conversion, or another build, under the same name */
+        fclose (f);
+        return IMGCVT_ERR;
+    }
+    if (fstat (fileno (f), &st) != 0 || !S_ISREG (st.st_mode) || (uint64_t)st.st_size != L_CACHE_HDR_SIZE + (uint64_t)entry->rawSize)
+    {   /* truncated, or not written from a raw file: it would be loaded forever */
+        fclose (f);
+        unlink (entry->path);
+        return IMGCVT_ERR;
+    }
+
+    out = fopen (outFname, "wb");
+    if (out == NULL)
+    {
+        fclose (f);
+        return IMGCVT_ERR;
+    }
+    result = CopyFile (f, out);
+    if (fclose (out) != 0)
+        result = IMGCVT_ERR;
+    fclose (f);
+    return result;
+}
+
+/* Add the output of a conversion to the cache. The entry is written under a
+   temporary name and renamed, so concurrent runs never see a partial entry.
+   Only an output that is a regular file of the raw image size is read back:
+   a device or a pipe does not give the image again.
+   The cache is only an optimization: errors are ignored.
+    Args: <entry>[in] the cache entry.
+          <cacheDir>[in] cache directory.
+          <outFname>[in] output raw file path.
+    Ret:
+*/
+static void CacheStore (const CacheEntry_t *entry, const char *cacheDir, const char *outFname)
+{
+    size_t len = strlen (cacheDir) + sizeof ("/.tmpXXXXXX");
+    char *tmp;
+    struct stat st;
+    FILE *src;
+    int fd;
+
+    /* non blocking: opening a fifo with no writer must not wait */
+    fd = open (outFname, O_RDONLY | O_NONBLOCK);
+    if (fd < 0)
+        return;
+    if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || (uint64_t)st.st_size != (uint64_t)entry->rawSize ||
+        fcntl (fd, F_SETFL, 0) != 0 || (src = fdopen (fd, "rb")) == NULL)
+    {
+        close (fd);
+        return;
+    }
+
+    tmp = malloc (len);
+    if (tmp == NULL)
+    {
+        fclose (src);
+        return;
+    }
+    snprintf (tmp, len, "%s/.tmpXXXXXX", cacheDir);
+    fd = mkstemp (tmp);
+    if (fd >= 0)
+    {
+        FILE *f = fdopen (fd, "wb");
+        imgcvt_Result_e result = IMGCVT_ERR;
+
+        if (f != NULL)
+        {
+            if (fwrite (entry->hdr, 1, L_CACHE_HDR_SIZE, f) == L_CACHE_HDR_SIZE)
+                result = CopyFile (src, f);
+            if (fclose (f) != 0)
+                result = IMGCVT_ERR;
+        }
+        else
+            close (fd);
+
+        if (result != IMGCVT_OK || rename (tmp, entry->path) != 0)
+            unlink (tmp);
+    }
+    fclose (src);
+    free (tmp);
+}
+
+/* Start a SHA-256 hash.
+    Args: <sha>[out] the hash.
+    Ret:
+*/
+static void Sha256Init (Sha256_t *sha)
+{
+    static const uint32_t init[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy (sha->state, init, sizeof (init));
+    sha->bytes = 0;
+}
+
+/* Hash a 64 byte block of SHA-256.
+    Args: <state>[in/out] the hash of the blocks before it.
+          <block>[in] the block.
+    Ret:
+*/
+static void Sha256Block (uint32_t state[8], const uint8_t *block)
+{
+    static const uint32_t k[64] =
+    {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+    uint32_t w[64];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = L_ROTR32 (w[i - 15], 7) ^ L_ROTR32 (w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = L_ROTR32 (w[i - 2], 17) ^ L_ROTR32 (w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = h + (L_ROTR32 (e, 6) ^ L_ROTR32 (e, 11) ^ L_ROTR32 (e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+        uint32_t t2 = (L_ROTR32 (a, 2) ^ L_ROTR32 (a, 13) ^ L_ROTR32 (a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+/* Add bytes to a SHA-256 hash.
+    Args: <sha>[in/out] the hash.
+          <data>[in] the bytes.
+          <size>[in] number of bytes.
+    Ret:
+*/
+static void Sha256Update (Sha256_t *sha, const uint8_t *data, size_t size)
+{
+    size_t fill = (size_t)(sha->bytes % 64);
+
+    sha->bytes += size;
+    if (fill > 0)
+    {   /* complete the partial block first */
+        size_t n = 64 - fill < size ? 64 - fill : size;
+
+        memcpy (&sha->block[fill], data, n);
+        data += n;
+        size -= n;
+        if (fill + n < 64)
+            return;
+        Sha256Block (sha->state, sha->block);
+    }
+    for (; size >= 64; data += 64, size -= 64)
+        Sha256Block (sha->state, data);
+    memcpy (sha->block, data, size);
+}
+
+/* Finish a SHA-256 hash.
+    Args: <sha>[in] the hash, not usable after this.
+          <digest>[out] the 32 byte hash.
+    Ret:
+*/
+static void Sha256Final (Sha256_t *sha, uint8_t digest[32])
+{
+    uint8_t pad[72] = { 0x80 };
+    uint64_t bits = sha->bytes * 8;
+    size_t fill = (size_t)(sha->bytes % 64);
+    size_t padLen = (fill < 56 ? 56 : 120) - fill; // the length ends the last block
+
+    for (int i = 0; i < 8; i++)
+        pad[padLen + i] = (uint8_t)(bits >> (56 - 8 * i));
+    Sha256Update (sha, pad, padLen + 8);
+    for (int i = 0; i < 32; i++)
+        digest[i] = (uint8_t)(sha->state[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+#if !defined(IMGCVT_NO_MAIN)
+/* Print the phase timing of a conversion on one line.
+    Args: <name>[in] image name.
+          <stats>[in] the phase timing.
+    Ret:
+*/
+static void PrintStats (const char *name, const imgcvt_Stats_t *stats)
+{
+    static const char *const phaseNames[IMGCVT_PHASE_NUM] =
+    {
+        "load", "parse", "inflate", "unfilter", "rgba", "pixels", "write",
+    };
+    char line[512];
+    double total = 0;
+    int len;
+
+    len = snprintf (line, sizeof (line), "%s:", name);
+    for (int p = 0; p < IMGCVT_PHASE_NUM && len < (int)sizeof (line); p++)
+    {
+        len += snprintf (&line[len], sizeof (line) - len, " %s %.3f ms %llu B,", phaseNames[p],
+                         stats->seconds[p] * 1e3, (unsigned long long)stats->bytes[p]);
+        total += stats->seconds[p];
+    }
+    printf ("%s total %.3f ms\n", line, total * 1e3);
+}
+#endif
+#endif
+
+#if defined(L_STATS)
+/* Read the phase timer clock.
+    Args:
+    Ret: monotonic time in seconds.
+*/
+static double StatsNow (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Add the time elapsed since a start time to a phase, then restart from now.
+    Args: <stats>[in] phase timing, nothing is done when NULL.
+          <start>[in/out] start time, set to now.
+          <phase>[in] the phase (IMGCVT_PHASE_...).
+          <bytes>[in] bytes output by the phase.
+          <outer>[in] phase whose time includes this one and loses it, -1 if none.
+    Ret:
+*/
+static void StatsAdd (imgcvt_Stats_t *stats, double *start, int phase, uint64_t bytes, int outer)
+{
+    double now;
+
+    if (stats == NULL)
+        return;
+    now = StatsNow ( );
+    stats->seconds[phase] += now - *start;
+    stats->bytes[phase] += bytes;
+    if (outer >= 0)
+        stats->seconds[outer] -= now - *start;
+    *start = now;
+}
+
+/* Add the lodepng decoder phases to the conversion phases.
+    Args: <stats>[in] phase timing, nothing is done when NULL.
+          <dec>[in] decoder phase timing.
+          <outer>[in] phase whose time includes the decoding and loses it, -1 if none.
+    Ret:
+*/
+static void StatsAddDecoder (imgcvt_Stats_t *stats, const LodePNGDecodeStats *dec, int outer)
+{
+    double decTime = dec->parse_time + dec->inflate_time + dec->unfilter_time + dec->convert_time;
+
+    if (stats == NULL)
+        return;
+    stats->seconds[IMGCVT_PHASE_PARSE] += dec->parse_time;
+    stats->bytes[IMGCVT_PHASE_PARSE] += dec->parse_bytes;
+    stats->seconds[IMGCVT_PHASE_INFLATE] += dec->inflate_time;
+    stats->bytes[IMGCVT_PHASE_INFLATE] += dec->inflate_bytes;
+    stats->seconds[IMGCVT_PHASE_UNFILTER] += dec->unfilter_time;
+    stats->bytes[IMGCVT_PHASE_UNFILTER] += dec->unfilter_bytes;
+    stats->seconds[IMGCVT_PHASE_RGBA] += dec->convert_time;
+    stats->bytes[IMGCVT_PHASE_RGBA] += dec->convert_bytes;
+    if (outer >= 0)
+        stats->seconds[outer] -= decTime;
+}
+#endif
+
+/* Main program function, called after all input oprions are parsed.
+    Args: <ctx>[in] conversion options.
+          <dec>[in] decoder kept between images, NULL if none.
+    Ret:
+*/
+static imgcvt_Result_e Convert (const imgcvt_Ctx_t *ctx, Decoder_t *dec)
+{
+    uint32_t error;
+    InFile_t in;
+    uint8_t* image = 0;
+    uint32_t width, height;
+    bool stream;
+    imgcvt_Result_e result = IMGCVT_OK;
+#if !defined(IMGCVT_MCU)
+    CacheEntry_t cache = { NULL };
+#endif
+    L_ARENA_BEGIN;
+
+    L_STATS_BEGIN (tLoad);
+    error = InFileLoad (&in, ctx->in_fname);
+    L_STATS_ADD (ctx->stats, tLoad, IMGCVT_PHASE_LOAD, in.size);
+    const uint8_t *png = in.data;
+    size_t pngSize = in.size;
+#if !defined(IMGCVT_MCU)
+    if (!error && ctx->cache_dir != NULL)
+    {   /* the same conversion was already done: reuse its output */
+        if (CacheEntryInit (&cache, ctx, png, pngSize) == IMGCVT_OK && CacheLoad (&cache, ctx->out_fname) == IMGCVT_OK)
+        {
+            L_STATS_ADD (ctx->stats, tLoad, IMGCVT_PHASE_WRITE, 0);
+            free (cache.path);
+            InFileRelease (&in);
+            L_ARENA_END;
+            return IMGCVT_OK;
+        }
+    }
+#endif
+    /* rows kept in png order are converted while decoding, without holding the image */
+    stream = !error && CanStream (ctx, dec, png, pngSize, &width, &height);
+    if (!error && !stream)
+        error = DecodeImage (ctx, dec, &image, &width, &height, png, pngSize);
+    if(error) {
+        fprintf(stderr, "%s: error %u: %s\n", ctx->in_fname, error, lodepng_error_text(error));
+        result = IMGCVT_ERR;
+    }
+    else
+    {
+        /*use image here*/
+        OutFile_t of;
+        OutBuf_t ob;
+        uint8_t bytesPxl = PxlFormatTable[ctx->clr_format].bytes_pxl;
+        size_t rawSize = L_HEADER_SIZE + (size_t)width * height * bytesPxl;
+        /* room for a row or for a band of rotated rows */
+        size_t minSize = stream || width > L_TILE_COLS * height ? width : L_TILE_COLS * height;
+        L_STATS_BEGIN (tOut);
+
+        if (OutFileOpen (&of, &ob, ctx->out_fname, rawSize, bytesPxl * minSize) != IMGCVT_OK) {
+            fprintf (stderr, "%s: i can't open the output file %s\n", ctx->in_fname, ctx->out_fname);
+            result = IMGCVT_ERR;
+        }
+        else
+        {
+            L_STATS_ADD (ctx->stats, tOut, IMGCVT_PHASE_WRITE, 0);
+            ob.stats = ctx->stats;
+            if (stream) {
+                result = StreamRaw (ctx, dec, &ob, png, pngSize, width, height);
+            }
+            else if (WriteRaw (ctx, &ob, image, width, height) != IMGCVT_OK) {
+                result = IMGCVT_ERR;
+            }
+            if (OutFileClose (&of, &ob) != IMGCVT_OK) {
+                result = IMGCVT_ERR;
+            }
+            /* the writes and a streaming decode time themselves inside this phase */
+            L_STATS_ADD (ctx->stats, tOut, IMGCVT_PHASE_PIXELS, rawSize - L_HEADER_SIZE);
+            if (result != IMGCVT_OK) {
+                OutFileDiscard (&of, ctx->out_fname); // a png corrupt after some rows, a failed write: drop the partial or preallocated image
+            }
+        }
+    }
+
+#if !defined(IMGCVT_MCU)
+    if (result == IMGCVT_OK && cache.path != NULL)
+        CacheStore (&cache, ctx->cache_dir, ctx->out_fname);
+    free (cache.path);
+#endif
+    InFileRelease (&in);
+    FreeImage (image);
+    L_ARENA_END;
+    return result;
+}
+
+/* Get the bytes of an input file. The file is mapped in memory so the decoder
+   reads the chunks straight from the page cache, it is loaded with lodepng
+   when it can't be mapped.
+    Args: <in>[out] the file bytes, release them with InFileRelease.
+          <fname>[in] file path.
+    Ret: 0 on success, a lodepng error code otherwise.
+*/
+static unsigned InFileLoad (InFile_t *in, const char *fname)
+{
+    in->data = NULL;
+    in->size = 0;
+    in->mapped = false;
+#if !defined(IMGCVT_MCU)
+    int fd = open (fname, O_RDONLY);
+
+    if (fd >= 0)
+    {
+        struct stat st;
+
+        if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0)
+        {
+            void *map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (map != MAP_FAILED)
+            {
+                posix_madvise (map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+                in->data = map;
+                in->size = (size_t)st.st_size;
+                in->mapped = true;
+            }
+        }
+        close (fd);
+        if (in->mapped)
+            return 0;
+    }
+#endif
+    return lodepng_load_file (&in->data, &in->size, fname);
+}
+
+/* Release the bytes of an input file.
+    Args: <in>[in] the file bytes got with InFileLoad.
+    Ret:
+*/
+static void InFileRelease (InFile_t *in)
+{
+#if !defined(IMGCVT_MCU)
+    if (in->mapped)
+    {
+        munmap (in->data, in->size);
+        return;
+    }
+#endif
+    FreeImage (in->data);
+}
+
+/* Convert a png image held in memory into a raw image held in memory.
+    Args: <ctx>[in] conversion options.
+          <png>[in] png file bytes.
+          <pngSize>[in] png file size.
+          <out>[in/out] destination buffer, allocated here when NULL.
+          <outSize>[in/out] destination buffer size / raw image size.
+    Ret:
+*/
+static imgcvt_Result_e ConvertMemory (const imgcvt_Ctx_t *ctx, const uint8_t *png, size_t pngSize, uint8_t **out, size_t *outSize)
+{
+    uint32_t error;
+    uint8_t* image = 0;
+    uint32_t width, height;
+    imgcvt_Result_e result = IMGCVT_OK;
+    L_ARENA_BEGIN;
+
+    error = DecodeImage (ctx, NULL, &image, &width, &height, png, pngSize);
+    if (error) {
+        result = IMGCVT_ERR;
+    }
+    else
+    {
+        size_t rawSize = L_HEADER_SIZE + (size_t)width * height * PxlFormatTable[ctx->clr_format].bytes_pxl;
+        uint8_t *dst = *out;
+
+        if (dst == NULL) {
+            dst = malloc (rawSize);
+        }
+        else if (*outSize < rawSize) {
+            dst = NULL; // the caller buffer is too small
+        }
+
+        if (dst == NULL) {
+            result = IMGCVT_ERR;
+        }
+        else
+        {
+            OutBuf_t ob;
+            L_STATS_BEGIN (tOut);
+
+            OutBufInitMem (&ob, dst, rawSize);
+            if (WriteRaw (ctx, &ob, image, width, height) != IMGCVT_OK)
+            {
+                result = IMGCVT_ERR;
+                if (*out == NULL)
+                    free (dst);
+            }
+            else
+                *out = dst;
+            L_STATS_ADD (ctx->stats, tOut, IMGCVT_PHASE_PIXELS, rawSize - L_HEADER_SIZE);
+        }
+        *outSize = rawSize;
+    }
+
+    FreeImage (image);
+    L_ARENA_END;
+    return result;
+}
+
+/* Decode a png to RGBA8888, like lodepng_decode32 but timing the decoder phases.
+    Args: <ctx>[in] conversion options.
+          <dec>[in] decoder kept between images, NULL if none.
+          <image>[out] RGBA8888 pixel map, release it with FreeImage.
+          <width>[out] image width.
+          <height>[out] image height.
+          <png>[in] png file bytes.
+          <pngSize>[in] png file size.
+    Ret: 0 on success, a lodepng error code otherwise.
+*/
+static unsigned DecodeImage (const imgcvt_Ctx_t *ctx, Decoder_t *dec, uint8_t **image, uint32_t *width, uint32_t *height, const uint8_t *png, size_t pngSize)
+{
+    LodePNGState local;
+    LodePNGState *state = DecoderAcquire (ctx, dec, &local);
+    unsigned w, h;
+    unsigned error;
+
+    state->info_raw.colortype = LCT_RGBA;
+    state->info_raw.bitdepth = 8;
+#if defined(L_STATS)
+    LodePNGDecodeStats decStats = { 0 };
+
+    decStats.now = StatsNow;
+    if (ctx->stats != NULL)
+        state->decoder.stats = &decStats;
+#endif
+    error = lodepng_decode (image, &w, &h, state, png, pngSize);
+    DecoderRelease (dec, state);
+#if defined(L_STATS)
+    StatsAddDecoder (ctx->stats, &decStats, -1);
+#endif
+    *width = w;
+    *height = h;
+    return error;
+}
+
+/* Write the simple raw image header.
+    Args: <ctx>[in] conversion options.
+          <ob>[in] append the header to this buffer.
+          <width>[in] image width.
+          <height>[in] image height.
+    Ret:
+*/
+static imgcvt_Result_e WriteHeader (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, uint32_t width, uint32_t height)
+{
+    uint8_t *hdr = OutBufReserve (ob, L_HEADER_SIZE);
+
+    if (hdr == NULL) {
+        return IMGCVT_ERR;
+    }
+    memcpy (&hdr[0], "RAW", 3);
+    memcpy (&hdr[3], "v01", 3);
+    hdr[6] = ctx->ori;
+    hdr[7] = ctx->clr_format;
+    GetBeInt32t (&hdr[8], width);
+    GetBeInt32t (&hdr[12], height);
+    GetBeInt32t (&hdr[16], L_HEADER_SIZE);
+    memset (&hdr[20], '-', L_HEADER_SIZE - 20); // to reach 32 chars
+    return IMGCVT_OK;
+}
+
+/* Get the row conversion kernel of a context.
+    Args: <ctx>[in] conversion options.
+    Ret: the forced kernel, or the best one the cpu supports.
+*/
+static FuncWriteRow_t CtxWriteRow (const imgcvt_Ctx_t *ctx)
+{
+    return SelectWriteRow (ctx->clr_format, ctx->kernel == -1 ? DetectKernel ( ) : (Kernel_e)ctx->kernel);
+}
+
+/* Check if an image can be converted while it is decoded: the orientation
+   must keep the png row order and the png must not be interlaced. For 180°
+   the output must also be a regular file (or not exist yet), the bands of
+   rows are written at their own file offset.
+    Args: <ctx>[in] conversion options.
+          <dec>[in] decoder kept between images, NULL if none.
+          <png>[in] png file bytes.
+          <pngSize>[in] png file size.
+          <width>[out] image width.
+          <height>[out] image height.
+    Ret: true to use StreamRaw.
+*/
+static bool CanStream (const imgcvt_Ctx_t *ctx, Decoder_t *dec, const uint8_t *png, size_t pngSize, uint32_t *width, uint32_t *height)
+{
+    LodePNGState local;
+    LodePNGState *state;
+    bool stream;
+
+    if (ctx->ori != IMGCVT_ORI_0 && ctx->ori != IMGCVT_ORI_180)
+        return false;
+#if !defined(IMGCVT_MCU)
+    struct stat st;
+
+    if (ctx->ori == IMGCVT_ORI_180 && stat (ctx->out_fname, &st) == 0 && !S_ISREG (st.st_mode))
+        return false; // a pipe or a device can't seek: the image is decoded first
+#endif
+    state = DecoderAcquire (ctx, dec, &local);
+    stream = lodepng_inspect (width, height, state, png, pngSize) == 0 && state->info_png.interlace_method == 0;
+    DecoderRelease (dec, state);
+    return stream;
+}
+
+/* Decode a png and write the raw image a row at a time: only a few rows are
+   ever in memory. 180° rows are gathered bottom up in the output buffer and
+   each full band is written at its own file offset.
+    Args: <ctx>[in] conversion options.
+          <dec>[in] decoder kept between images, NULL if none.
+          <ob>[in] file output buffer, room for at least a row.
+          <png>[in] png file bytes.
+          <pngSize>[in] png file size.
+          <width>[in] image width.
+          <height>[in] image height.
+    Ret:
+*/
+static imgcvt_Result_e StreamRaw (const imgcvt_Ctx_t *ctx, Decoder_t *dec, OutBuf_t *ob, const uint8_t *png, size_t pngSize, uint32_t width, uint32_t height)
+{
+    LodePNGState local;
+    LodePNGState *state;
+    RowSink_t sink;
+    unsigned w, h;
+    unsigned error;
+
+    sink.ob = ob;
+    sink.wr_row = CtxWriteRow (ctx);
+    sink.bytes_pxl = PxlFormatTable[ctx->clr_format].bytes_pxl;
+    sink.w = width;
+    sink.h = height;
+    sink.rev = NULL;
+    sink.pixels = NULL;
+    sink.band_rows = 0;
+    sink.failed = false;
+
+    if (WriteHeader (ctx, ob, width, height) != IMGCVT_OK) {
+        return IMGCVT_ERR;
+    }
+    if (ctx->ori == IMGCVT_ORI_180 && ob->f == NULL)
+    {   /* the rows are written straight at their place */
+        sink.pixels = OutBufReserve (ob, (size_t)width * height * sink.bytes_pxl);
+        if (sink.pixels == NULL) {
+            return IMGCVT_ERR;
+        }
+    }
+    else if (ctx->ori == IMGCVT_ORI_180)
+    {   /* the rows are written by band, the buffer holds only the band */
+        if (OutBufFlush (ob) != IMGCVT_OK) {
+            return IMGCVT_ERR;
+        }
+        ob->len = 0;
+        sink.band_rows = ob->size / ((size_t)width * sink.bytes_pxl);
+    }
+    if (ctx->ori == IMGCVT_ORI_180)
+    {
+        sink.rev = malloc ((size_t)width * 4);
+        if (sink.rev == NULL) {
+            return IMGCVT_ERR;
+        }
+    }
+
+    state = DecoderAcquire (ctx, dec, &local);
+#if defined(L_STATS)
+    LodePNGDecodeStats decStats = { 0 };
+
+    decStats.now = StatsNow;
+    if (ob->stats != NULL)
+        state->decoder.stats = &decStats;
+#endif
+    error = lodepng_decode_rows (&w, &h, state, png, pngSize, StreamRow, &sink);
+    DecoderRelease (dec, state);
+#if defined(L_STATS)
+    StatsAddDecoder (ob->stats, &decStats, IMGCVT_PHASE_PIXELS); // the decoding ran inside the pixels phase
+#endif
+    free (sink.rev);
+
+    if (error && !sink.failed) {
+        fprintf (stderr, "%s: error %u: %s\n", ctx->in_fname, error, lodepng_error_text (error));
+    }
+    return error ? IMGCVT_ERR : IMGCVT_OK;
+}
+
+/* Streaming decode row callback: convert a RGBA8888 row.
+    Args: <context>[in] the RowSink_t.
+          <y>[in] row index.
+          <row>[in] RGBA8888 row.
+    Ret: 0 to continue decoding.
+*/
+static unsigned StreamRow (void *context, unsigned y, const unsigned char *row)
+{
+    RowSink_t *sink = context;
+    size_t rowBytes = (size_t)sink->w * sink->bytes_pxl;
+    uint8_t *out;
+
+    if (sink->rev == NULL)
+    {
+        out = OutBufReserve (sink->ob, rowBytes);
+        if (out == NULL) {
+            sink->failed = true;
+            return 1;
+        }
+        sink->wr_row (out, row, sink->w);
+        return 0;
+    }
+
+    /* 180°: mirror the row and store it bottom up */
+    for (uint32_t x = 0; x < sink->w; x++)
+        memcpy (&sink->rev[x * 4], &row[(size_t)(sink->w - 1 - x) * 4], 4);
+    if (sink->pixels != NULL)
+    {
+        sink->wr_row (&sink->pixels[(size_t)(sink->h - 1 - y) * rowBytes], sink->rev, sink->w);
+        return 0;
+    }
+
+    uint32_t fill = y % sink->band_rows + 1; // band rows after this one
+    uint32_t first = sink->band_rows - fill; // band slot of this row
+
+    sink->wr_row (&sink->ob->buf[first * rowBytes], sink->rev, sink->w);
+
+    if (fill == sink->band_rows || y == sink->h - 1)
+    {
+        long offset = (long)(L_HEADER_SIZE + (size_t)(sink->h - 1 - y) * rowBytes);
+        L_STATS_BEGIN (tWrite);
+
+        if (fseek (sink->ob->f, offset, SEEK_SET) != 0 ||
+            Fwrite (&sink->ob->buf[first * rowBytes], fill * rowBytes, sink->ob->f) != IMGCVT_OK) {
+            sink->failed = true;
+            return 1;
+        }
+        L_STATS_NESTED (sink->ob->stats, tWrite, IMGCVT_PHASE_WRITE, fill * rowBytes, IMGCVT_PHASE_PIXELS);
+    }
+    return 0;
+}
+
+/* Write the raw image header and pixels.
+    Args: <ctx>[in] conversion options.
+          <ob>[in] append the raw image to this buffer.
+          <image>[in] RGBA8888 pixel map.
+          <width>[in] image width.
+          <height>[in] image height.
+    Ret:
+*/
+static imgcvt_Result_e WriteRaw (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, const uint8_t *image, uint32_t width, uint32_t height)
+{
+    uint32_t outRows = ctx->ori == IMGCVT_ORI_90 || ctx->ori == IMGCVT_ORI_270 ? width : height;
+
+    if (WriteHeader (ctx, ob, width, height) != IMGCVT_OK) {
+        return IMGCVT_ERR;
+    }
+
+#if !defined(IMGCVT_MCU)
+    /* in memory every band of output rows has its own place: convert the bands in parallel */
+    uint64_t nBands = ctx->threads;
+
+    if (nBands > (uint64_t)width * height / L_BAND_MIN_PIXELS)
+        nBands = (uint64_t)width * height / L_BAND_MIN_PIXELS;
+    if (nBands > outRows / L_TILE_COLS)
+        nBands = outRows / L_TILE_COLS;
+    if (ob->f == NULL && nBands > 1)
+        return TraverseBands (ctx, ob, image, width, height, (unsigned)nBands);
+#endif
+    return TraverseBand (ctx, ob, image, width, height, 0, outRows);
+}
+
+/* Write a band of output rows of the image pixels.
+    Args: <ctx>[in] conversion options.
+          <ob>[in] append the pixels to this buffer.
+          <image>[in] RGBA8888 pixel map.
+          <width>[in] image width.
+          <height>[in] image height.
+          <first>[in] first output row to write.
+          <num>[in] number of output rows to write.
+    Ret:
+*/
+static imgcvt_Result_e TraverseBand (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, const uint8_t *image, uint32_t width, uint32_t height, uint32_t first, uint32_t num)
+{
+    FuncWriteRow_t writePxl = CtxWriteRow (ctx); // pixel row write function
+    uint8_t bytesPxl = PxlFormatTable[ctx->clr_format].bytes_pxl;
+
+    if (writePxl == PxlFormatTable[ctx->clr_format].func_write[KERNEL_SCALAR])
+    {   /* no vector kernel: the specialized traversal converts inline */
+        return PxlFormatTable[ctx->clr_format].func_traverse[ctx->ori] (ob, image, width, height, first, num);
+    }
+    return TraversePixelTable[ctx->ori] (ob, image, width, height, first, num, writePxl, bytesPxl);
+}
+
+#if !defined(IMGCVT_MCU)
+/* Conversion thread: write a band of output rows.
+    Args: <arg>[in] the Band_t.
+    Ret: NULL.
+*/
+static void *BandWorker (void *arg)
+{
+    Band_t *band = arg;
+
+    band->result = TraverseBand (band->ctx, &band->ob, band->img, band->w, band->h, band->first, band->num);
+    return NULL;
+}
+
+/* Write the image pixels with a thread per band of output rows. Every band
+   is converted straight at its place in memory, so the output is the same
+   byte by byte as a serial conversion. The calling thread converts the
+   first band, and any band whose thread could not be started.
+    Args: <ctx>[in] conversion options.
+          <ob>[in] memory output buffer, the pixels are appended to it.
+          <image>[in] RGBA8888 pixel map.
+          <width>[in] image width.
+          <height>[in] image height.
+          <nBands>[in] number of bands, at most the output rows / L_TILE_COLS.
+    Ret:
+*/
+static imgcvt_Result_e TraverseBands (const imgcvt_Ctx_t *ctx, OutBuf_t *ob, const uint8_t *image, uint32_t width, uint32_t height, unsigned nBands)
+{
+    bool cols = ctx->ori == IMGCVT_ORI_90 || ctx->ori == IMGCVT_ORI_270;
+    uint32_t outRows = cols ? width : height;
+    size_t rowBytes = (size_t)(cols ? height : width) * PxlFormatTable[ctx->clr_format].bytes_pxl;
+    uint8_t *pixels = OutBufReserve (ob, outRows * rowBytes);
+    Band_t *bands = malloc (nBands * sizeof (*bands));
+    pthread_t *threads = malloc (nBands * sizeof (*threads));
+    imgcvt_Result_e result = IMGCVT_OK;
+
+    if (pixels == NULL || bands == NULL || threads == NULL)
+    {
+        free (bands);
+        free (threads);
+        return IMGCVT_ERR;
+    }
+
+    for (unsigned i = 0; i < nBands; i++)
+    {   /* band limits on tile boundaries, the column traversals work by tile */
+        uint32_t first = (uint64_t)outRows * i / nBands / L_TILE_COLS * L_TILE_COLS;
+        uint32_t next = i + 1 < nBands ? (uint64_t)outRows * (i + 1) / nBands / L_TILE_COLS * L_TILE_COLS : outRows;
+        Band_t *band = &bands[i];
+
+        band->ctx = ctx;
+        OutBufInitMem (&band->ob, &pixels[first * rowBytes], (next - first) * rowBytes);
+        band->img = image;
+        band->w = width;
+        band->h = height;
+        band->first = first;
+        band->num = next - first;
+        band->threaded = i > 0 && pthread_create (&threads[i], NULL, BandWorker, band) == 0;
+    }
+
+    for (unsigned i = 0; i < nBands; i++)
+    {
+        if (!bands[i].threaded)
+            BandWorker (&bands[i]);
+    }
+    for (unsigned i = 0; i < nBands; i++)
+    {
+        if (bands[i].threaded)
+            pthread_join (threads[i], NULL);
+        if (bands[i].result != IMGCVT_OK)
+            result = IMGCVT_ERR;
+    }
+
+    free (bands);
+    free (threads);
+    return result;
+}
+#endif
+
+/* Release an image decoded by lodepng.
+    Args: <image>[in] the image.
+    Ret:
+*/
+static void FreeImage (uint8_t *image)
+{
+#ifdef LODEPNG_COMPILE_ALLOCATORS
+    free(image);
+#else
+    lodepng_free(image);
+#endif
+}
+
+#if !defined(IMGCVT_MCU) && !defined(IMGCVT_NO_MAIN)
+/* Make a decoder kept from an image to the next one. Call it outside of any
+   conversion, so that in arena builds its memory is not dropped after an image.
+    Args: <dec>[out] the decoder, release it with DecoderCleanup.
+    Ret: IMGCVT_OK on success.
+*/
+static imgcvt_Result_e DecoderInit (Decoder_t *dec)
+{
+    lodepng_state_init (&dec->state);
+    if (lodepng_scratch_init (&dec->scratch) != 0) {
+        return IMGCVT_ERR;
+    }
+    dec->state.decoder.zlibsettings.scratch = &dec->scratch;
+    return IMGCVT_OK;
+}
+
+/* Release a decoder.
+    Args: <dec>[in] the decoder made by DecoderInit.
+    Ret:
+*/
+static void DecoderCleanup (Decoder_t *dec)
+{
+    lodepng_scratch_cleanup (&dec->scratch);
+    lodepng_state_cleanup (&dec->state);
+}
+#endif
+
+/* Get the lodepng state to decode an image with.
+    Args: <ctx>[in] conversion options.
+          <dec>[in] decoder kept between images, NULL if none.
+          <local>[in] state initialised here and used when there is no decoder.
+    Ret: the state, release it with DecoderRelease.
+*/
+static LodePNGState *DecoderAcquire (const imgcvt_Ctx_t *ctx, Decoder_t *dec, LodePNGState *local)
+{
+    LodePNGState *state = local;
+
+    if (dec != NULL) {
+        state = &dec->state;
+    }
+    else {
+        lodepng_state_init (local);
+    }
+    state->decoder.ignore_crc = ctx->ignore_crc;
+    return state;
+}
+
+/* Release the lodepng state of an image. The png header of a decoder state is
+   cleared, its memory belongs to the conversion.
+    Args: <dec>[in] decoder kept between images, NULL if none.
+          <state>[in] the state got with DecoderAcquire.
+    Ret:
+*/
+static void DecoderRelease (Decoder_t *dec, LodePNGState *state)
+{
+    if (dec == NULL) {
+        lodepng_state_cleanup (state);
+        return;
+    }
+    lodepng_info_cleanup (&state->info_png);
+    lodepng_info_init (&state->info_png);
+#if defined(L_STATS)
+    state->decoder.stats = NULL;
+#endif
+}
+
+#if defined(L_ARENA)
+/* lodepng allocators of arena builds. During a conversion the blocks of a thread
+   are taken one after the other from its current chunk, a new chunk is added when
+   it is full. Freeing the newest blocks gives their room back, the others stay
+   until ArenaEnd. Outside of a conversion the blocks come from the heap, so what
+   is kept between images (like a Decoder_t) is not dropped. */
+void* lodepng_malloc (size_t size)
+{
+    Arena_t *arena = &ThreadArena;
+    ArenaChunk_t *top = arena->top;
+    ArenaBlock_t *block;
+    size_t need;
+
+    if (size > ((size_t)-1) / 2)
+        return NULL;
+    need = L_ARENA_BLOCK_HDR + L_ARENA_ROUND (size);
+    if (arena->depth == 0)
+    {
+        block = malloc (need);
+        if (block == NULL)
+            return NULL;
+        block->size = (need - L_ARENA_BLOCK_HDR) | L_ARENA_HEAP;
+        block->prev = L_ARENA_NONE;
+        return (uint8_t *)block + L_ARENA_BLOCK_HDR;
+    }
+    if (top == NULL || top->size - top->used < need)
+    {
+        top = ArenaChunkNew (need > L_ARENA_CHUNK ? need : L_ARENA_CHUNK, top);
+        if (top == NULL)
+            return NULL;
+        arena->top = top;
+        ArenaRegister (arena);
+    }
+    block = L_ARENA_BLOCK (top, top->used);
+    block->size = need - L_ARENA_BLOCK_HDR;
+    block->prev = top->last;
+    top->last = top->used;
+    top->used += need;
+    return (uint8_t *)block + L_ARENA_BLOCK_HDR;
+}
+
+/* The block is kept when it is large enough, the newest block of the chunk grows
+   in place when the chunk has room, any other one is moved to a new block. */
+void* lodepng_realloc (void* ptr, size_t new_size)
+{
+    ArenaChunk_t *top = ThreadArena.top;
+    ArenaBlock_t *block;
+    void *moved;
+
+    if (ptr == NULL)
+        return lodepng_malloc (new_size);
+    block = (ArenaBlock_t *)((uint8_t *)ptr - L_ARENA_BLOCK_HDR);
+    if (new_size <= (block->size & ~(size_t)L_ARENA_HEAP))
+        return ptr;
+    if (block->size & L_ARENA_HEAP)
+    {
+        if (new_size > ((size_t)-1) / 2)
+            return NULL;
+        block = realloc (block, L_ARENA_BLOCK_HDR + L_ARENA_ROUND (new_size));
+        if (block == NULL)
+            return NULL;
+        block->size = L_ARENA_ROUND (new_size) | L_ARENA_HEAP;
+        return (uint8_t *)block + L_ARENA_BLOCK_HDR;
+    }
+    if (new_size <= ((size_t)-1) / 2 && top->last != L_ARENA_NONE && block == L_ARENA_BLOCK (top, top->last) &&
+        L_ARENA_ROUND (new_size) - block->size <= top->size - top->used)
+    {
+        top->used += L_ARENA_ROUND (new_size) - block->size;
+        block->size = L_ARENA_ROUND (new_size);
+        return ptr;
+    }
+    moved = lodepng_malloc (new_size);
+    if (moved == NULL)
+        return NULL; // the old block is still valid, like with realloc
+    memcpy (moved, ptr, block->size);
+    lodepng_free (ptr);
+    return moved;
+}
+
+void lodepng_free (void* ptr)
+{
+    ArenaChunk_t *top = ThreadArena.top;
+    ArenaBlock_t *block;
+
+    if (ptr == NULL)
+        return;
+    block = (ArenaBlock_t *)((uint8_t *)ptr - L_ARENA_BLOCK_HDR);
+    if (block->size & L_ARENA_HEAP)
+    {
+        free (block);
+        return;
+    }
+    block->size |= L_ARENA_FREED;
+    /* drop the freed blocks from the end of the chunk */
+    while (top->last != L_ARENA_NONE && (L_ARENA_BLOCK (top, top->last)->size & L_ARENA_FREED))
+    {
+        top->used = top->last;
+        top->last = L_ARENA_BLOCK (top, top->last)->prev;
+    }
+}
+
+/* Allocate an empty arena chunk.
+    Args: <size>[in] bytes for the blocks.
+          <prev>[in] the current chunk of the arena, NULL if none.
+    Ret: the chunk, NULL when out of memory.
+*/
+static ArenaChunk_t *ArenaChunkNew (size_t size, ArenaChunk_t *prev)
+{
+    ArenaChunk_t *chunk = malloc (L_ARENA_CHUNK_HDR + size);
+
+    if (chunk != NULL)
+    {
+        chunk->prev = prev;
+        chunk->size = size;
+        chunk->used = 0;
+        chunk->last = L_ARENA_NONE;
+    }
+    return chunk;
+}
+
+/* Release the arena chunks of the calling thread when it exits.
+    Args: <arena>[in] the arena of the calling thread.
+    Ret:
+*/
+static void ArenaRegister (Arena_t *arena)
+{
+#if !defined(IMGCVT_MCU)
+    if (!arena->registered && pthread_once (&ArenaKeyOnce, ArenaKeyCreate) == 0 &&
+        pthread_setspecific (ArenaKey, arena) == 0)
+        arena->registered = true;
+#else
+    (void)arena;
+#endif
+}
+
+/* Free a list of arena chunks.
+    Args: <top>[in] the newest chunk.
+    Ret:
+*/
+static void ArenaFreeChunks (ArenaChunk_t *top)
+{
+    while (top != NULL)
+    {
+        ArenaChunk_t *prev = top->prev;
+
+        free (top);
+        top = prev;
+    }
+}
+
+#if !defined(IMGCVT_MCU)
+/* Thread exit destructor of the arena key.
+    Args: <arg>[in] the arena of the exiting thread.
+    Ret:
+*/
+static void ArenaThreadExit (void *arg)
+{
+    Arena_t *arena = arg;
+
+    ArenaFreeChunks (arena->top);
+    arena->top = NULL;
+    arena->registered = false;
+}
+
+/* Create the key whose destructor releases the arena of an exiting thread.
+    Args:
+    Ret:
+*/
+static void ArenaKeyCreate (void)
+{
+    pthread_key_create (&ArenaKey, ArenaThreadExit);
+}
+#endif
+
+/* Start a conversion in the calling thread: the lodepng memory comes from its arena
+   until the conversion ends.
+    Args:
+    Ret:
+*/
+static void ArenaBegin (void)
+{
+    ThreadArena.depth++;
+}
+
+/* End a conversion in the calling thread, its lodepng memory is dropped at once
+   when no other conversion is in progress. The memory of the arena chunks is kept
+   as a single chunk, so the next image of the same size takes it without calling
+   malloc, up to L_ARENA_KEEP bytes.
+    Args:
+    Ret:
+*/
+static void ArenaEnd (void)
+{
+    Arena_t *arena = &ThreadArena;
+    size_t total = 0;
+
+    if (--arena->depth > 0 || arena->top == NULL)
+        return;
+    if (arena->top->prev == NULL && arena->top->size <= L_ARENA_KEEP)
+    {
+        arena->top->used = 0;
+        arena->top->last = L_ARENA_NONE;
+        return;
+    }
+    for (ArenaChunk_t *chunk = arena->top; chunk != NULL; chunk = chunk->prev)
+        total += chunk->size;
+    ArenaFreeChunks (arena->top);
+    arena->top = total <= L_ARENA_KEEP ? ArenaChunkNew (total, NULL) : NULL;
+}
+#endif
+
+/* Get the fastest conversion kernel variant the cpu supports.
+    Args:
+    Ret: the kernel variant.
+*/
+static Kernel_e DetectKernel (void)
+{
+#if defined(L_X86_KERNELS)
+    __builtin_cpu_init ( );
+    if (__builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx512bw"))
+        return KERNEL_AVX512;
+    if (__builtin_cpu_supports ("avx2"))
+        return KERNEL_AVX2;
+    if (__builtin_cpu_supports ("ssse3"))
+        return KERNEL_SSSE3;
+    if (__builtin_cpu_supports ("sse2"))
+        return KERNEL_SSE2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+/* Pick the row conversion function of a color format.
+    Args: <clrFormat>[in] output color format.
+          <kernel>[in] fastest kernel variant allowed, the best available
+                       one up to it is used (every format has a scalar one).
+    Ret: the row conversion function.
+*/
+static FuncWriteRow_t SelectWriteRow (int8_t clrFormat, Kernel_e kernel)
+{
+    while (PxlFormatTable[clrFormat].func_write[kernel] == NULL)
+        kernel--;
+    return PxlFormatTable[clrFormat].func_write[kernel];
+}
+
+/* Write to a file and returns 0 on success.
+    Args: <ptr>[in] what to write.
+          <size>[in] size in bytes.
+          <stream>[in] the file stream.
+    Ret:
+*/
+static imgcvt_Result_e Fwrite (void *ptr, size_t size, FILE *stream)
+{
+    if (fwrite (ptr, 1, size, stream) != size)
+        return IMGCVT_ERR;
+    return IMGCVT_OK;
+}
+
+/* Get big endian 32bit number rappresentation.
+    Args: <leVal>[out] little endian number rappresentation.
+          <val>[in] value to get le rappresentation.
+    Ret:
+*/
+static void GetBeInt32t (uint8_t *leVal, int32_t val)
+{
+    leVal[3] = (val >>  0) & 0xff;
+    leVal[2] = (val >>  8) & 0xff;
+    leVal[1] = (val >> 16) & 0xff;
+    leVal[0] = (val >> 24) & 0xff;
+}
+
+/* Initialize an output staging buffer.
+    Args: <ob>[out] the staging buffer.
+          <f>[in] the stream the buffer is flushed to.
+          <minSize>[in] the buffer must be able to hold at least this many bytes.
+    Ret: IMGCVT_OK on success.
+*/
+static imgcvt_Result_e OutBufInit (OutBuf_t *ob, FILE *f, size_t minSize)
+{
+    ob->f = f;
+    ob->len = 0;
+    ob->size = minSize > L_OUT_BUF_SIZE ? minSize : L_OUT_BUF_SIZE;
+    ob->stats = NULL;
+    ob->buf = malloc (ob->size);
+    if (ob->buf == NULL)
+        return IMGCVT_ERR;
+    return IMGCVT_OK;
+}
+
+/* Initialize an output buffer that writes straight into memory.
+    Args: <ob>[out] the output buffer.
+          <dst>[in] destination memory.
+          <size>[in] destination memory size.
+    Ret:
+*/
+static void OutBufInitMem (OutBuf_t *ob, uint8_t *dst, size_t size)
+{
+    ob->f = NULL;
+    ob->buf = dst;
+    ob->len = 0;
+    ob->size = size;
+    ob->stats = NULL;
+}
+
+/* Release the memory held by an output staging buffer.
+    Args: <ob>[in] the staging buffer.
+    Ret:
+*/
+static void OutBufCleanup (OutBuf_t *ob)
+{
+    if (ob->f != NULL)
+        free (ob->buf);
+    ob->buf = NULL;
+    ob->len = ob->size = 0;
+}
+
+/* Get room for <n> more bytes in the staging buffer, flushing it if needed.
+    Args: <ob>[in] the staging buffer.
+          <n>[in] number of bytes the caller is going to write.
+    Ret: pointer to write the bytes to, NULL on write error.
+*/
+static uint8_t *OutBufReserve (OutBuf_t *ob, size_t n)
+{
+    uint8_t *ptr;
+
+    if (ob->len + n > ob->size)
+    {
+        if (ob->f == NULL || OutBufFlush (ob) != IMGCVT_OK || n > ob->size)
+            return NULL;
+    }
+    ptr = &ob->buf[ob->len];
+    ob->len += n;
+    return ptr;
+}
+
+/* Write all the staged bytes to the stream.
+    Args: <ob>[in] the staging buffer.
+    Ret: IMGCVT_OK on success.
+*/
+static imgcvt_Result_e OutBufFlush (OutBuf_t *ob)
+{
+    imgcvt_Result_e result = IMGCVT_OK;
+
+    if (ob->f == NULL)
+        return IMGCVT_OK; // already in place
+    if (ob->len > 0)
+    {
+        L_STATS_BEGIN (tWrite);
+        result = Fwrite (ob->buf, ob->len, ob->f);
+        L_STATS_NESTED (ob->stats, tWrite, IMGCVT_PHASE_WRITE, ob->len, IMGCVT_PHASE_PIXELS);
+    }
+    ob->len = 0;
+    return result;
+}
+
+/* Open an output file of known size. Large regular files are preallocated and
+   mapped: the output buffer is then the file itself and pixels are written in
+   place, without staging and in any order. Otherwise, or when the file can't
+   be mapped, the output buffer stages the pixels for stdio. Fifos and devices
+   are opened once and written like fopen would, they are never truncated.
+    Args: <of>[out] the output file.
+          <ob>[out] the output buffer writing to the file.
+          <fname>[in] file path.
+          <size>[in] final file size.
+          <minBufSize>[in] minimum staging buffer size.
+    Ret: IMGCVT_OK on success.
+*/
+static imgcvt_Result_e OutFileOpen (OutFile_t *of, OutBuf_t *ob, const char *fname, size_t size, size_t minBufSize)
+{
+    of->map = NULL;
+    of->size = size;
+#if !defined(IMGCVT_MCU)
+    struct stat st;
+    int fd = open (fname, O_WRONLY | O_CREAT | O_EXCL, 0666);
+
+    of->created = fd >= 0;
+    /* without a reader a fifo fails with ENXIO instead of blocking: it is then opened again waiting for one */
+    if (fd < 0 && errno == EEXIST)
+        fd = open (fname, O_WRONLY | O_CREAT | O_NONBLOCK, 0666);
+    if (fd < 0 && errno == ENXIO)
+        fd = open (fname, O_WRONLY);
+    if (fd < 0)
+        return IMGCVT_ERR;
+    if (fstat (fd, &st) != 0 || fcntl (fd, F_SETFL, 0) != 0)
+    {
+        close (fd);
+        return IMGCVT_ERR;
+    }
+    of->regular = S_ISREG (st.st_mode);
+
+    if (of->regular && size > L_OUT_BUF_SIZE)
+    {   /* small files are a single fwrite anyway. The mapping needs a read/write descriptor of the same file */
+        int rw = open (fname, O_RDWR);
+        struct stat rwSt;
+
+        /* reserve the blocks up front: a full disk is an error here instead of a SIGBUS later */
+        if (rw >= 0 && fstat (rw, &rwSt) == 0 && rwSt.st_dev == st.st_dev && rwSt.st_ino == st.st_ino &&
+            ftruncate (rw, (off_t)size) == 0 && posix_fallocate (rw, 0, (off_t)size) == 0)
+        {
+            void *map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rw, 0);
+
+            if (map != MAP_FAILED)
+                of->map = map;
+        }
+        if (rw >= 0)
+            close (rw);
+    }
+    if (of->map != NULL)
+    {
+        close (fd);
+        of->f = NULL;
+        OutBufInitMem (ob, of->map, size);
+        return IMGCVT_OK;
+    }
+
+    /* stdio on the descriptor already open: a regular file is emptied, anything else is written as it is */
+    if (of->regular && ftruncate (fd, 0) != 0)
+    {
+        close (fd);
+        return IMGCVT_ERR;
+    }
+    of->f = fdopen (fd, "wb");
+    if (of->f == NULL)
+    {
+        close (fd);
+        return IMGCVT_ERR;
+    }
+#else
+    of->regular = true;
+    of->created = false;
+    of->f = fopen (fname, "wb");
+    if (of->f == NULL)
+        return IMGCVT_ERR;
+#endif
+    if (OutBufInit (ob, of->f, minBufSize) != IMGCVT_OK)
+    {
+        fclose (of->f);
+        return IMGCVT_ERR;
+    }
+    return IMGCVT_OK;
+}
+
+/* Write the staged bytes and close an output file.
+    Args: <of>[in] the output file.
+          <ob>[in] its output buffer.
+    Ret: IMGCVT_OK on success.
+*/
+static imgcvt_Result_e OutFileClose (OutFile_t *of, OutBuf_t *ob)
+{
+    imgcvt_Result_e result = IMGCVT_OK;
+
+#if !defined(IMGCVT_MCU)
+    if (of->map != NULL)
+    {   /* the pixels are already in the file pages */
+        L_STATS_BEGIN (tWrite);
+        OutBufCleanup (ob);
+        if (munmap (of->map, of->size) != 0)
+            result = IMGCVT_ERR;
+        L_STATS_NESTED (ob->stats, tWrite, IMGCVT_PHASE_WRITE, of->size, IMGCVT_PHASE_PIXELS);
+        return result;
+    }
+#endif
+    if (OutBufFlush (ob) != IMGCVT_OK)
+        result = IMGCVT_ERR;
+    L_STATS_BEGIN (tWrite);
+    if (fclose (of->f) != 0)
+        result = IMGCVT_ERR;
+    L_STATS_NESTED (ob->stats, tWrite, IMGCVT_PHASE_WRITE, 0, IMGCVT_PHASE_PIXELS);
+    OutBufCleanup (ob);
+    return result;
+}
+
+/* Drop what a failed conversion wrote to its output file, once it is closed.
+   Only a regular file is touched: it is removed if the conversion created
+   it, emptied otherwise. A fifo or a device, also through a link, is left
+   alone.
+    Args: <of>[in] the closed output file.
+          <fname>[in] file path.
+    Ret:
+*/
+static void OutFileDiscard (const OutFile_t *of, const char *fname)
+{
+#if !defined(IMGCVT_MCU)
+    if (of->created && of->regular)
+        unlink (fname);
+    else if (of->regular && truncate (fname, 0) != 0)
+        fprintf (stderr, "i can't empty the output file %s\n", fname);
+#else
+    (void)of;
+    remove (fname); // no links or special files here
+#endif
+}
+
+/* Write a band of output rows of the image pixels to file.
+    Args: <ob>[in] append all pixel to this buffer.
+          <img>[in] RGBA8888 pixel map.
+          <w>[in] image width.
+          <h>[in] image height.
+          <first>[in] first output row to write.
+          <num>[in] number of output rows to write.
+          <wrRow>[in] function used to convert a row of pixels.
+          <bytesPxl>[in] output bytes per pixel.
+    Ret:
+*/
+static imgcvt_Result_e TraversePixelOri0 (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl)
+{
+    (void)h; // the rows are the png ones, only the other orientations need the height
+    for (uint32_t y = first; y < first + num; y++)
+    {
+        uint8_t *out;
+
+        out = OutBufReserve (ob, (size_t)w * bytesPxl);
+        if (out == NULL) {
+            return IMGCVT_ERR;
+        }
+        wrRow (out, &img[(size_t)y * w * 4], w);
+    }
+    return IMGCVT_OK;
+}
+
+/* Write a band of output rows of the image pixels to file.
+    Args: <ob>[in] append all pixel to this buffer.
+          <img>[in] RGBA8888 pixel map.
+          <w>[in] image width.
+          <h>[in] image height.
+          <first>[in] first output row to write.
+          <num>[in] number of output rows to write.
+          <wrRow>[in] function used to convert a row of pixels.
+          <bytesPxl>[in] output bytes per pixel.
+    Ret:
+*/
+static imgcvt_Result_e TraversePixelOri90 (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl)
+{
+    return TraversePixelColumns (ob, img, w, h, first, num, wrRow, bytesPxl, true);
+}
+
+/* Write a band of output rows of the image pixels to file.
+    Args: <ob>[in] append all pixel to this buffer.
+          <img>[in] RGBA8888 pixel map.
+          <w>[in] image width.
+          <h>[in] image height.
+          <first>[in] first output row to write.
+          <num>[in] number of output rows to write.
+          <wrRow>[in] function used to convert a row of pixels.
+          <bytesPxl>[in] output bytes per pixel.
+    Ret:
+*/
+static imgcvt_Result_e TraversePixelOri180 (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl)
+{
+    uint8_t *row; // output row gathered as RGBA8888
+
+    row = malloc ((size_t)w * 4);
+    if (row == NULL) {
+        return IMGCVT_ERR;
+    }
+    for (uint32_t y = first; y < first + num; y++)
+    {
+        const uint8_t *in = &img[(size_t)(h - 1 - y) * w * 4];
+        uint8_t *out;
+
+        for (uint32_t x = 0; x < w; x++)
+            memcpy (&row[x * 4], &in[(size_t)(w - 1 - x) * 4], 4);
+
+        out = OutBufReserve (ob, (size_t)w * bytesPxl);
+        if (out == NULL) {
+            free (row);
+            return IMGCVT_ERR;
+        }
+        wrRow (out, row, w);
+    }
+    free (row);
+    return IMGCVT_OK;
+}
+
+/* Write a band of output rows of the image pixels to file.
+    Args: <ob>[in] append all pixel to this buffer.
+          <img>[in] RGBA8888 pixel map.
+          <w>[in] image width.
+          <h>[in] image height.
+          <first>[in] first output row to write.
+          <num>[in] number of output rows to write.
+          <wrRow>[in] function used to convert a row of pixels.
+          <bytesPxl>[in] output bytes per pixel.
+    Ret:
+*/
+static imgcvt_Result_e TraversePixelOri270 (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl)
+{
+    return TraversePixelColumns (ob, img, w, h, first, num, wrRow, bytesPxl, false);
+}
+
+/* Transpose a band of image columns into consecutive RGBA8888 output rows.
+   The input is read row by row, so every input cache line is loaded once
+   for the whole band instead of once per output pixel.
+    Args: <band>[out] <nCols> output rows of <h> pixels each.
           <img>[in] RGBA8888 pixel map.
           <w>[in] image width.
           <h>[in] image height.
-          <wrPxl>[in] function used to write pixel in file.
+          <x>[in] image column of the first output row.
+          <nCols>[in] number of columns in the band.
+          <cw>[in] true for the 90 orientation (columns right to left, pixels
+                   top to bottom), false for 270 (columns left to right,
+                   pixels bottom to top).
     Ret:
 */
-static imgcvt_Result_e TraversePixelOri180 (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl)
+static void GatherColumns (uint8_t *band, const uint8_t *img, uint32_t w, uint32_t h, uint32_t x, uint32_t nCols, bool cw)
 {
-    for (int y = h - 1; y >= 0; y--)
+    for (uint32_t y = 0; y < h; y++)
     {
-        for (int x = w - 1; x >= 0; x--)
-        {
-            uint8_t *inClr;
+        const uint8_t *in = &img[((size_t)y * w + x) * 4];
+        uint8_t *out = &band[(size_t)(cw ? y : h - 1 - y) * 4];
 
-            inClr = &img[(x + y * w) * 4];
-            if (wrPxl (f, inClr) != IMGCVT_OK) {
-                return IMGCVT_ERR;
-            }
+        if (cw)
+        {
+            for (uint32_t k = 0; k < nCols; k++)
+                memcpy (&out[(size_t)k * h * 4], in - (size_t)k * 4, 4);
+        }
+        else
+        {
+            for (uint32_t k = 0; k < nCols; k++)
+                memcpy (&out[(size_t)k * h * 4], in + (size_t)k * 4, 4);
         }
     }
-    return IMGCVT_OK;
 }
 
-/* Write all image pixel to file.
-    Args: <f>[in] append all pixel to the file.
+/* Write a band of output rows of the image pixels to file, one output row per image column.
+    Args: <ob>[in] append all pixel to this buffer.
           <img>[in] RGBA8888 pixel map.
           <w>[in] image width.
           <h>[in] image height.
-          <wrPxl>[in] function used to write pixel in file.
+          <first>[in] first output row to write.
+          <num>[in] number of output rows to write.
+          <wrRow>[in] function used to convert a row of pixels.
+          <bytesPxl>[in] output bytes per pixel.
+          <cw>[in] true for the 90 orientation, false for 270.
     Ret:
 */
-static imgcvt_Result_e TraversePixelOri270 (FILE *f, uint8_t *img, uint32_t w, uint32_t h, FuncWritePxl_t wrPxl)
+static imgcvt_Result_e TraversePixelColumns (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, FuncWriteRow_t wrRow, uint8_t bytesPxl, bool cw)
 {
-    for (int x = 0; x < w; x++)
+    uint8_t *band; // band of output rows gathered as RGBA8888
+
+    band = malloc ((size_t)L_TILE_COLS * h * 4);
+    if (band == NULL) {
+        return IMGCVT_ERR;
+    }
+    for (uint32_t done = first; done < first + num; )
     {
-        for (int y = h - 1; y >= 0; y--)
+        uint32_t nCols = first + num - done < L_TILE_COLS ? first + num - done : L_TILE_COLS;
+
+        GatherColumns (band, img, w, h, cw ? w - 1 - done : done, nCols, cw);
+        for (uint32_t k = 0; k < nCols; k++)
         {
-            uint8_t *inClr;
+            uint8_t *out;
 
-            inClr = &img[(x + y * w) * 4];
-            if (wrPxl (f, inClr) != IMGCVT_OK) {
+            out = OutBufReserve (ob, (size_t)h * bytesPxl);
+            if (out == NULL) {
+                free (band);
                 return IMGCVT_ERR;
             }
+            wrRow (out, &band[(size_t)k * h * 4], h);
         }
+        done += nCols;
     }
+    free (band);
     return IMGCVT_OK;
 }
 
-/* Add pixel to file.
-    Args: <f>[in] append pxl to this file.
-          <inClr>[in] RGBA8888 input color.
+/* Convert a pixel.
+    Args: <out>[out] converted pixel.
+          <in>[in] RGBA8888 input color.
     Ret:
 */
-static imgcvt_Result_e WriteClrARGB8888 (FILE *f, uint8_t *inClr)
+static inline void PxlARGB8888 (uint8_t *out, const uint8_t *in)
 {
-    uint8_t outClr[4];
-
-    outClr[0] = inClr[3];
-    outClr[1] = inClr[0];
-    outClr[2] = inClr[1];
-    outClr[3] = inClr[2];
-    return Fwrite (&outClr, sizeof (outClr), f);
+    out[0] = in[3];
+    out[1] = in[0];
+    out[2] = in[1];
+    out[3] = in[2];
 }
 
-/* Add pixel to file.
-    Args: <f>[in] append pxl to this file.
-          <inClr>[in] RGBA8888 input color.
+/* Convert a pixel.
+    Args: <out>[out] converted pixel.
+          <in>[in] RGBA8888 input color.
     Ret:
 */
-static imgcvt_Result_e WriteClrBGRA8888 (FILE *f, uint8_t *inClr)
+static inline void PxlBGRA8888 (uint8_t *out, const uint8_t *in)
 {
-    uint8_t outClr[4];
+    out[0] = in[2];
+    out[1] = in[1];
+    out[2] = in[0];
+    out[3] = in[3];
+}
 
-    outClr[0] = inClr[2];
-    outClr[1] = inClr[1];
-    outClr[2] = inClr[0];
-    outClr[3] = inClr[3];
-    return Fwrite (&outClr, sizeof (outClr), f);
+/* Convert a pixel.
+    Args: <out>[out] converted pixel.
+          <in>[in] RGBA8888 input color.
+    Ret:
+*/
+static inline void PxlRGBA8888 (uint8_t *out, const uint8_t *in)
+{
+    memcpy (out, in, 4);
 }
 
-/* Add pixel to file.
-    Args: <f>[in] append pxl to this file.
-          <inClr>[in] RGBA8888 input color.
+/* Convert a pixel.
+    Args: <out>[out] converted pixel.
+          <in>[in] RGBA8888 input color.
     Ret:
 */
-static imgcvt_Result_e WriteClrRGBA8888 (FILE *f, uint8_t *inClr)
+static inline void PxlRGB565LE (uint8_t *out, const uint8_t *in)
 {
-    uint8_t outClr[4];
+    uint16_t color; // rgb565 color
+
+    color =  (in[0] >> 3) << (6 + 5);
+    color += (in[1] >> 2) << (5);
+    color += (in[2] >> 3) << (0);
 
-    outClr[0] = inClr[0];
-    outClr[1] = inClr[1];
-    outClr[2] = inClr[2];
-    outClr[3] = inClr[3];
-    return Fwrite (&outClr, sizeof (outClr), f);
+    out[0] = (color) & 0xff;
+    out[1] = (color >> 8) & 0xff;
 }
 
-/* Add pixel to file.
-    Args: <f>[in] append pxl to this file.
-          <inClr>[in] RGBA8888 input color.
+/* Convert a pixel.
+    Args: <out>[out] converted pixel.
+          <in>[in] RGBA8888 input color.
     Ret:
 */
-static imgcvt_Result_e WriteClrRGB565LE (FILE *f, uint8_t *inClr)
+static inline void PxlRGB565BE (uint8_t *out, const uint8_t *in)
 {
-    uint8_t outClr[2];
     uint16_t color; // rgb565 color
 
-    color =  (inClr[0] >> 3) << (6 + 5);
-    color += (inClr[1] >> 2) << (5);
-    color += (inClr[2] >> 3) << (0);
+    color =  (in[0] >> 3) << (6 + 5);
+    color += (in[1] >> 2) << (5);
+    color += (in[2] >> 3) << (0);
 
-    outClr[0] = (color) & 0xff;
-    outClr[1] = (color >> 8) & 0xff;
-    return Fwrite (&outClr, sizeof (outClr), f);
+    out[0] = (color >> 8) & 0xff;
+    out[1] = (color) & 0xff;
 }
 
-/* Add pixel to file.
-    Args: <f>[in] append pxl to this file.
-          <inClr>[in] RGBA8888 input color.
+/* Convert a pixel.
+    Args: <out>[out] converted pixel.
+          <in>[in] RGBA8888 input color.
     Ret:
 */
-static imgcvt_Result_e WriteClrRGB565BE (FILE *f, uint8_t *inClr)
+static inline void PxlARGB565LE (uint8_t *out, const uint8_t *in)
 {
-    uint8_t outClr[2];
     uint16_t color; // rgb565 color
 
-    color =  (inClr[0] >> 3) << (6 + 5);
-    color += (inClr[1] >> 2) << (5);
-    color += (inClr[2] >> 3) << (0);
+    color =  (in[0] >> 3) << (6 + 5);
+    color += (in[1] >> 2) << (5);
+    color += (in[2] >> 3) << (0);
 
-    outClr[0] = (color >> 8) & 0xff;
-    outClr[1] = (color) & 0xff;
-    return Fwrite (&outClr, sizeof (outClr), f);
+    out[0] = in[3];
+    out[1] = (color) & 0xff;
+    out[2] = (color >> 8) & 0xff;
 }
 
-/* Add pixel to file.
-    Args: <f>[in] append pxl to this file.
-          <inClr>[in] RGBA8888 input color.
+/* Convert a pixel.
+    Args: <out>[out] converted pixel.
+          <in>[in] RGBA8888 input color.
     Ret:
 */
-static imgcvt_Result_e WriteClrARGB565LE (FILE *f, uint8_t *inClr)
+static inline void PxlARGB565BE (uint8_t *out, const uint8_t *in)
 {
-    uint8_t outClr[3];
     uint16_t color; // rgb565 color
 
-    color =  (inClr[0] >> 3) << (6 + 5);
-    color += (inClr[1] >> 2) << (5);
-    color += (inClr[2] >> 3) << (0);
+    color =  (in[0] >> 3) << (6 + 5);
+    color += (in[1] >> 2) << (5);
+    color += (in[2] >> 3) << (0);
 
-    outClr[0] = inClr[3];
-    outClr[1] = (color) & 0xff;
-    outClr[2] = (color >> 8) & 0xff;
-    return Fwrite (&outClr, sizeof (outClr), f);
+    out[0] = in[3];
+    out[1] = (color >> 8) & 0xff;
+    out[2] = (color) & 0xff;
 }
 
-/* Add pixel to file.
-    Args: <f>[in] append pxl to this file.
-          <inClr>[in] RGBA8888 input color.
+/* Scalar kernels of every color format. Each one expands to:
+   - WriteClr<fmt>: converts a row of pixels (used by the vector kernels for
+     the row tails).
+   - TraverseOri<0|90|180|270><fmt>: writes the whole image in the given
+     orientation, with Pxl<fmt> inlined in the traversal loop so that no
+     function pointer is called per pixel or per row. The 90 and 270 ones
+     convert bands of L_TILE_COLS image columns straight into the staging
+     buffer, reading the source row by row like GatherColumns does.
+*/
+#define L_DEFINE_FORMAT_KERNELS(fmt, bytesPxl) \
+static void WriteClr##fmt (uint8_t *out, const uint8_t *in, uint32_t n) \
+{ \
+    for (uint32_t i = 0; i < n; i++) \
+        Pxl##fmt (&out[(size_t)i * (bytesPxl)], &in[(size_t)i * 4]); \
+} \
+\
+static imgcvt_Result_e TraverseOri0##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num) \
+{ \
+    (void)h; \
+    for (uint32_t y = first; y < first + num; y++) \
+    { \
+        const uint8_t *in = &img[(size_t)y * w * 4]; \
+        uint8_t *out = OutBufReserve (ob, (size_t)w * (bytesPxl)); \
+\
+        if (out == NULL) { \
+            return IMGCVT_ERR; \
+        } \
+        for (uint32_t x = 0; x < w; x++) \
+            Pxl##fmt (&out[(size_t)x * (bytesPxl)], &in[(size_t)x * 4]); \
+    } \
+    return IMGCVT_OK; \
+} \
+\
+static imgcvt_Result_e TraverseOri180##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num) \
+{ \
+    for (uint32_t y = first; y < first + num; y++) \
+    { \
+        const uint8_t *in = &img[((size_t)(h - 1 - y) * w + w - 1) * 4]; \
+        uint8_t *out = OutBufReserve (ob, (size_t)w * (bytesPxl)); \
+\
+        if (out == NULL) { \
+            return IMGCVT_ERR; \
+        } \
+        for (uint32_t x = 0; x < w; x++) \
+            Pxl##fmt (&out[(size_t)x * (bytesPxl)], in - (size_t)x * 4); \
+    } \
+    return IMGCVT_OK; \
+} \
+\
+static inline imgcvt_Result_e TraverseColumns##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num, bool cw) \
+{ \
+    for (uint32_t done = first; done < first + num; ) \
+    { \
+        uint32_t nCols = first + num - done < L_TILE_COLS ? first + num - done : L_TILE_COLS; \
+        uint32_t x = cw ? w - 1 - done : done; \
+        uint8_t *band = OutBufReserve (ob, (size_t)nCols * h * (bytesPxl)); \
+\
+        if (band == NULL) { \
+            return IMGCVT_ERR; \
+        } \
+        for (uint32_t y = 0; y < h; y++) \
+        { \
+            const uint8_t *in = &img[((size_t)y * w + x) * 4]; \
+            uint8_t *out = &band[(size_t)(cw ? y : h - 1 - y) * (bytesPxl)]; \
+\
+            for (uint32_t k = 0; k < nCols; k++) \
+                Pxl##fmt (&out[(size_t)k * h * (bytesPxl)], cw ? in - (size_t)k * 4 : in + (size_t)k * 4); \
+        } \
+        done += nCols; \
+    } \
+    return IMGCVT_OK; \
+} \
+\
+static imgcvt_Result_e TraverseOri90##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num) \
+{ \
+    return TraverseColumns##fmt (ob, img, w, h, first, num, true); \
+} \
+\
+static imgcvt_Result_e TraverseOri270##fmt (OutBuf_t *ob, const uint8_t *img, uint32_t w, uint32_t h, uint32_t first, uint32_t num) \
+{ \
+    return TraverseColumns##fmt (ob, img, w, h, first, num, false); \
+}
+
+L_DEFINE_FORMAT_KERNELS (ARGB8888, 4)
+L_DEFINE_FORMAT_KERNELS (BGRA8888, 4)
+L_DEFINE_FORMAT_KERNELS (RGBA8888, 4)
+L_DEFINE_FORMAT_KERNELS (RGB565LE, 2)
+L_DEFINE_FORMAT_KERNELS (RGB565BE, 2)
+L_DEFINE_FORMAT_KERNELS (ARGB565LE, 3)
+L_DEFINE_FORMAT_KERNELS (ARGB565BE, 3)
+
+#if defined(L_X86_KERNELS)
+/* Convert a row of pixels, 4 pixels per SSE2 register.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
     Ret:
 */
-static imgcvt_Result_e WriteClrARGB565BE (FILE *f, uint8_t *inClr)
+static L_TARGET ("sse2") void WriteClrARGB8888Sse2 (uint8_t *out, const uint8_t *in, uint32_t n)
 {
-    uint8_t outClr[3];
-    uint16_t color; // rgb565 color
+    uint32_t i = 0;
+
+    /* on little endian RGBA is 0xAABBGGRR and ARGB is 0xBBGGRRAA: a rotate left by 8 */
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)&in[i * 4]);
+
+        v = _mm_or_si128 (_mm_slli_epi32 (v, 8), _mm_srli_epi32 (v, 24));
+        _mm_storeu_si128 ((__m128i *)&out[i * 4], v);
+    }
+    WriteClrARGB8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 4 pixels per SSE2 register.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("sse2") void WriteClrBGRA8888Sse2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m128i maskAG = _mm_set1_epi32 ((int32_t)0xff00ff00);
+    uint32_t i = 0;
+
+    /* keep G and A in place, swap the R and B bytes */
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)&in[i * 4]);
+        __m128i rb = _mm_andnot_si128 (maskAG, v);
+
+        rb = _mm_or_si128 (_mm_slli_epi32 (rb, 16), _mm_srli_epi32 (rb, 16));
+        v = _mm_or_si128 (_mm_and_si128 (v, maskAG), rb);
+        _mm_storeu_si128 ((__m128i *)&out[i * 4], v);
+    }
+    WriteClrBGRA8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Permute the bytes of every pixel with a single pshufb per 4 pixels.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <mask>[in] pshufb mask.
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("ssse3") uint32_t ShuffleRowSsse3 (uint8_t *out, const uint8_t *in, uint32_t n, __m128i mask)
+{
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)&in[i * 4]);
+
+        _mm_storeu_si128 ((__m128i *)&out[i * 4], _mm_shuffle_epi8 (v, mask));
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 4 pixels per SSSE3 shuffle.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("ssse3") void WriteClrARGB8888Ssse3 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m128i mask = _mm_setr_epi8 (3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    uint32_t i;
+
+    i = ShuffleRowSsse3 (out, in, n, mask);
+    WriteClrARGB8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 4 pixels per SSSE3 shuffle.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("ssse3") void WriteClrBGRA8888Ssse3 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m128i mask = _mm_setr_epi8 (2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    uint32_t i;
+
+    i = ShuffleRowSsse3 (out, in, n, mask);
+    WriteClrBGRA8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Permute the bytes of every pixel with a single vpshufb per 8 pixels.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <mask>[in] vpshufb mask (the same permutation in both lanes).
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("avx2") uint32_t ShuffleRowAvx2 (uint8_t *out, const uint8_t *in, uint32_t n, __m256i mask)
+{
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256 ((const __m256i *)&in[i * 4]);
+
+        _mm256_storeu_si256 ((__m256i *)&out[i * 4], _mm256_shuffle_epi8 (v, mask));
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 8 pixels per AVX2 shuffle.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx2") void WriteClrARGB8888Avx2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m256i mask = _mm256_setr_epi8 (3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                           3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    uint32_t i;
+
+    i = ShuffleRowAvx2 (out, in, n, mask);
+    WriteClrARGB8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 8 pixels per AVX2 shuffle.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx2") void WriteClrBGRA8888Avx2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m256i mask = _mm256_setr_epi8 (2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                           2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    uint32_t i;
+
+    i = ShuffleRowAvx2 (out, in, n, mask);
+    WriteClrBGRA8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Compute the rgb565 color of 4 RGBA8888 pixels.
+    Args: <p>[in] 4 RGBA8888 pixels.
+    Ret: the rgb565 colors in the low 16 bits of each 32-bit lane.
+*/
+static inline L_TARGET ("sse2") __m128i Rgb565Sse2 (__m128i p)
+{
+    __m128i r, g, b;
+
+    r = _mm_slli_epi32 (_mm_and_si128 (p, _mm_set1_epi32 (0xf8)), 8);
+    g = _mm_and_si128 (_mm_srli_epi32 (p, 5), _mm_set1_epi32 (0x7e0));
+    b = _mm_and_si128 (_mm_srli_epi32 (p, 19), _mm_set1_epi32 (0x1f));
+    return _mm_or_si128 (_mm_or_si128 (r, g), b);
+}
+
+/* Compute the rgb565 color of 8 RGBA8888 pixels packed in 16-bit lanes.
+    Args: <in>[in] 8 RGBA8888 pixels.
+    Ret: 8 rgb565 colors.
+*/
+static inline L_TARGET ("sse2") __m128i Pack565Sse2 (const uint8_t *in)
+{
+    __m128i c0 = Rgb565Sse2 (_mm_loadu_si128 ((const __m128i *)&in[0]));
+    __m128i c1 = Rgb565Sse2 (_mm_loadu_si128 ((const __m128i *)&in[16]));
+
+    /* sign extend so that the signed saturating pack keeps all 16 bits */
+    c0 = _mm_srai_epi32 (_mm_slli_epi32 (c0, 16), 16);
+    c1 = _mm_srai_epi32 (_mm_slli_epi32 (c1, 16), 16);
+    return _mm_packs_epi32 (c0, c1);
+}
+
+/* Convert a row of pixels, 8 pixels per SSE2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("sse2") void WriteClrRGB565LESse2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128 ((__m128i *)&out[i * 2], Pack565Sse2 (&in[i * 4]));
+    WriteClrRGB565LE (&out[i * 2], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 8 pixels per SSE2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("sse2") void WriteClrRGB565BESse2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i c = Pack565Sse2 (&in[i * 4]);
+
+        c = _mm_or_si128 (_mm_slli_epi16 (c, 8), _mm_srli_epi16 (c, 8));
+        _mm_storeu_si128 ((__m128i *)&out[i * 2], c);
+    }
+    WriteClrRGB565BE (&out[i * 2], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, the 565 colors of 8 pixels are computed per SSE2
+   iteration and interleaved with the alpha bytes.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <be>[in] true for big endian colors.
+    Ret:
+*/
+static L_TARGET ("sse2") void WriteClrARGB565Sse2 (uint8_t *out, const uint8_t *in, uint32_t n, bool be)
+{
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        uint16_t color[8]; // rgb565 colors
+
+        _mm_storeu_si128 ((__m128i *)color, Pack565Sse2 (&in[i * 4]));
+        for (int k = 0; k < 8; k++)
+        {
+            uint8_t *o = &out[(i + k) * 3];
+
+            o[0] = in[(i + k) * 4 + 3];
+            o[1] = be ? color[k] >> 8 : color[k] & 0xff;
+            o[2] = be ? color[k] & 0xff : color[k] >> 8;
+        }
+    }
+    if (be)
+        WriteClrARGB565BE (&out[i * 3], &in[i * 4], n - i);
+    else
+        WriteClrARGB565LE (&out[i * 3], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 8 pixels per SSE2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("sse2") void WriteClrARGB565LESse2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    WriteClrARGB565Sse2 (out, in, n, false);
+}
+
+/* Convert a row of pixels, 8 pixels per SSE2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("sse2") void WriteClrARGB565BESse2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    WriteClrARGB565Sse2 (out, in, n, true);
+}
+
+/* Convert a row of pixels, 8 pixels per SSSE3 iteration. Every pixel is
+   built as (A << 16 | rgb565) and a pshufb drops the unused byte and puts
+   the remaining three in output order.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <mask>[in] pshufb mask compacting 4 pixels into 12 bytes.
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("ssse3") uint32_t ARGB565RowSsse3 (uint8_t *out, const uint8_t *in, uint32_t n, __m128i mask)
+{
+    const __m128i maskA = _mm_set1_epi32 (0xff0000);
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i p0 = _mm_loadu_si128 ((const __m128i *)&in[i * 4]);
+        __m128i p1 = _mm_loadu_si128 ((const __m128i *)&in[i * 4 + 16]);
+        __m128i v0, v1;
+
+        v0 = _mm_or_si128 (Rgb565Sse2 (p0), _mm_and_si128 (_mm_srli_epi32 (p0, 8), maskA));
+        v1 = _mm_or_si128 (Rgb565Sse2 (p1), _mm_and_si128 (_mm_srli_epi32 (p1, 8), maskA));
+        v0 = _mm_shuffle_epi8 (v0, mask); // 12 bytes
+        v1 = _mm_shuffle_epi8 (v1, mask); // 12 bytes
+        _mm_storeu_si128 ((__m128i *)&out[i * 3], _mm_or_si128 (v0, _mm_slli_si128 (v1, 12)));
+        _mm_storel_epi64 ((__m128i *)&out[i * 3 + 16], _mm_srli_si128 (v1, 4));
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 8 pixels per SSSE3 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("ssse3") void WriteClrARGB565LESsse3 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m128i mask = _mm_setr_epi8 (2, 0, 1, 6, 4, 5, 10, 8, 9, 14, 12, 13, -1, -1, -1, -1);
+    uint32_t i;
+
+    i = ARGB565RowSsse3 (out, in, n, mask);
+    WriteClrARGB565LE (&out[i * 3], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 8 pixels per SSSE3 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("ssse3") void WriteClrARGB565BESsse3 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m128i mask = _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    uint32_t i;
+
+    i = ARGB565RowSsse3 (out, in, n, mask);
+    WriteClrARGB565BE (&out[i * 3], &in[i * 4], n - i);
+}
+
+/* Compute the rgb565 color of 8 RGBA8888 pixels.
+    Args: <p>[in] 8 RGBA8888 pixels.
+    Ret: the rgb565 colors in the low 16 bits of each 32-bit lane.
+*/
+static inline L_TARGET ("avx2") __m256i Rgb565Avx2 (__m256i p)
+{
+    __m256i r, g, b;
+
+    r = _mm256_slli_epi32 (_mm256_and_si256 (p, _mm256_set1_epi32 (0xf8)), 8);
+    g = _mm256_and_si256 (_mm256_srli_epi32 (p, 5), _mm256_set1_epi32 (0x7e0));
+    b = _mm256_and_si256 (_mm256_srli_epi32 (p, 19), _mm256_set1_epi32 (0x1f));
+    return _mm256_or_si256 (_mm256_or_si256 (r, g), b);
+}
+
+/* Convert a row of pixels, 16 pixels per AVX2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <be>[in] true for big endian colors.
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("avx2") uint32_t RGB565RowAvx2 (uint8_t *out, const uint8_t *in, uint32_t n, bool be)
+{
+    const __m256i swap = _mm256_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                           1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i c0 = Rgb565Avx2 (_mm256_loadu_si256 ((const __m256i *)&in[i * 4]));
+        __m256i c1 = Rgb565Avx2 (_mm256_loadu_si256 ((const __m256i *)&in[i * 4 + 32]));
+        __m256i c;
+
+        /* the pack works per 128-bit lane, the permute restores pixel order */
+        c = _mm256_packus_epi32 (c0, c1);
+        c = _mm256_permute4x64_epi64 (c, 0xd8);
+        if (be)
+            c = _mm256_shuffle_epi8 (c, swap);
+        _mm256_storeu_si256 ((__m256i *)&out[i * 2], c);
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 16 pixels per AVX2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx2") void WriteClrRGB565LEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    uint32_t i;
+
+    i = RGB565RowAvx2 (out, in, n, false);
+    WriteClrRGB565LE (&out[i * 2], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 16 pixels per AVX2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx2") void WriteClrRGB565BEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    uint32_t i;
+
+    i = RGB565RowAvx2 (out, in, n, true);
+    WriteClrRGB565BE (&out[i * 2], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 16 pixels per AVX2 iteration. Same layout trick
+   as ARGB565RowSsse3, the 12 bytes of each 128-bit lane are then joined.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <mask>[in] vpshufb mask compacting 4 pixels into 12 bytes per lane.
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("avx2") uint32_t ARGB565RowAvx2 (uint8_t *out, const uint8_t *in, uint32_t n, __m256i mask)
+{
+    const __m256i maskA = _mm256_set1_epi32 (0xff0000);
+    const __m256i join = _mm256_setr_epi32 (0, 1, 2, 4, 5, 6, 3, 7);
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            const uint8_t *src = &in[(i + k * 8) * 4];
+            uint8_t *dst = &out[(i + k * 8) * 3];
+            __m256i p = _mm256_loadu_si256 ((const __m256i *)src);
+            __m256i v;
+
+            v = _mm256_or_si256 (Rgb565Avx2 (p), _mm256_and_si256 (_mm256_srli_epi32 (p, 8), maskA));
+            v = _mm256_shuffle_epi8 (v, mask);
+            v = _mm256_permutevar8x32_epi32 (v, join); // 24 bytes
+            _mm_storeu_si128 ((__m128i *)dst, _mm256_castsi256_si128 (v));
+            _mm_storel_epi64 ((__m128i *)&dst[16], _mm256_extracti128_si256 (v, 1));
+        }
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 16 pixels per AVX2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx2") void WriteClrARGB565LEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m256i mask = _mm256_setr_epi8 (2, 0, 1, 6, 4, 5, 10, 8, 9, 14, 12, 13, -1, -1, -1, -1,
+                                           2, 0, 1, 6, 4, 5, 10, 8, 9, 14, 12, 13, -1, -1, -1, -1);
+    uint32_t i;
+
+    i = ARGB565RowAvx2 (out, in, n, mask);
+    WriteClrARGB565LE (&out[i * 3], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 16 pixels per AVX2 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx2") void WriteClrARGB565BEAvx2 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m256i mask = _mm256_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    uint32_t i;
 
-    color =  (inClr[0] >> 3) << (6 + 5);
-    color += (inClr[1] >> 2) << (5);
-    color += (inClr[2] >> 3) << (0);
+    i = ARGB565RowAvx2 (out, in, n, mask);
+    WriteClrARGB565BE (&out[i * 3], &in[i * 4], n - i);
+}
+
+/* Permute the bytes of every pixel with a single vpshufb per 16 pixels.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <mask>[in] vpshufb mask (the same permutation in every lane).
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("avx512f,avx512bw") uint32_t ShuffleRowAvx512 (uint8_t *out, const uint8_t *in, uint32_t n, __m512i mask)
+{
+    uint32_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i v = _mm512_loadu_si512 ((const void *)&in[i * 4]);
+
+        _mm512_storeu_si512 ((void *)&out[i * 4], _mm512_shuffle_epi8 (v, mask));
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 16 pixels per AVX-512 shuffle.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx512f,avx512bw") void WriteClrARGB8888Avx512 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m512i mask = _mm512_broadcast_i32x4 (_mm_setr_epi8 (3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14));
+    uint32_t i;
+
+    i = ShuffleRowAvx512 (out, in, n, mask);
+    WriteClrARGB8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 16 pixels per AVX-512 shuffle.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx512f,avx512bw") void WriteClrBGRA8888Avx512 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m512i mask = _mm512_broadcast_i32x4 (_mm_setr_epi8 (2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+    uint32_t i;
+
+    i = ShuffleRowAvx512 (out, in, n, mask);
+    WriteClrBGRA8888 (&out[i * 4], &in[i * 4], n - i);
+}
+
+/* Compute the rgb565 color of 16 RGBA8888 pixels.
+    Args: <p>[in] 16 RGBA8888 pixels.
+    Ret: the rgb565 colors in the low 16 bits of each 32-bit lane.
+*/
+static inline L_TARGET ("avx512f,avx512bw") __m512i Rgb565Avx512 (__m512i p)
+{
+    __m512i r, g, b;
+
+    r = _mm512_slli_epi32 (_mm512_and_si512 (p, _mm512_set1_epi32 (0xf8)), 8);
+    g = _mm512_and_si512 (_mm512_srli_epi32 (p, 5), _mm512_set1_epi32 (0x7e0));
+    b = _mm512_and_si512 (_mm512_srli_epi32 (p, 19), _mm512_set1_epi32 (0x1f));
+    return _mm512_or_si512 (_mm512_or_si512 (r, g), b);
+}
+
+/* Convert a row of pixels, 32 pixels per AVX-512 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <be>[in] true for big endian colors.
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("avx512f,avx512bw") uint32_t RGB565RowAvx512 (uint8_t *out, const uint8_t *in, uint32_t n, bool be)
+{
+    const __m512i swap = _mm512_broadcast_i32x4 (_mm_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+    const __m512i order = _mm512_setr_epi64 (0, 2, 4, 6, 1, 3, 5, 7);
+    uint32_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m512i c0 = Rgb565Avx512 (_mm512_loadu_si512 ((const void *)&in[i * 4]));
+        __m512i c1 = Rgb565Avx512 (_mm512_loadu_si512 ((const void *)&in[i * 4 + 64]));
+        __m512i c;
+
+        /* the pack works per 128-bit lane, the permute restores pixel order */
+        c = _mm512_packus_epi32 (c0, c1);
+        c = _mm512_permutexvar_epi64 (order, c);
+        if (be)
+            c = _mm512_shuffle_epi8 (c, swap);
+        _mm512_storeu_si512 ((void *)&out[i * 2], c);
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 32 pixels per AVX-512 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx512f,avx512bw") void WriteClrRGB565LEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    uint32_t i;
+
+    i = RGB565RowAvx512 (out, in, n, false);
+    WriteClrRGB565LE (&out[i * 2], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 32 pixels per AVX-512 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx512f,avx512bw") void WriteClrRGB565BEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    uint32_t i;
+
+    i = RGB565RowAvx512 (out, in, n, true);
+    WriteClrRGB565BE (&out[i * 2], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 16 pixels per AVX-512 iteration. Same layout
+   trick as ARGB565RowSsse3, the 12 bytes of each 128-bit lane are then
+   joined and written with a masked store.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+          <mask>[in] vpshufb mask compacting 4 pixels into 12 bytes per lane.
+    Ret: number of pixels converted, the caller handles the rest.
+*/
+static L_TARGET ("avx512f,avx512bw") uint32_t ARGB565RowAvx512 (uint8_t *out, const uint8_t *in, uint32_t n, __m512i mask)
+{
+    const __m512i maskA = _mm512_set1_epi32 (0xff0000);
+    const __m512i join = _mm512_setr_epi32 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 3, 7, 11, 15);
+    uint32_t i = 0;
 
-    outClr[0] = inClr[3];
-    outClr[1] = (color >> 8) & 0xff;
-    outClr[2] = (color) & 0xff;
-    return Fwrite (&outClr, sizeof (outClr), f);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i p = _mm512_loadu_si512 ((const void *)&in[i * 4]);
+        __m512i v;
+
+        v = _mm512_or_si512 (Rgb565Avx512 (p), _mm512_and_si512 (_mm512_srli_epi32 (p, 8), maskA));
+        v = _mm512_shuffle_epi8 (v, mask);
+        v = _mm512_permutexvar_epi32 (join, v); // 48 bytes
+        _mm512_mask_storeu_epi8 ((void *)&out[i * 3], (__mmask64)0xffffffffffffULL, v);
+    }
+    return i;
+}
+
+/* Convert a row of pixels, 16 pixels per AVX-512 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx512f,avx512bw") void WriteClrARGB565LEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m512i mask = _mm512_broadcast_i32x4 (_mm_setr_epi8 (2, 0, 1, 6, 4, 5, 10, 8, 9, 14, 12, 13, -1, -1, -1, -1));
+    uint32_t i;
+
+    i = ARGB565RowAvx512 (out, in, n, mask);
+    WriteClrARGB565LE (&out[i * 3], &in[i * 4], n - i);
+}
+
+/* Convert a row of pixels, 16 pixels per AVX-512 iteration.
+    Args: <out>[out] converted pixels.
+          <in>[in] RGBA8888 input colors.
+          <n>[in] number of pixels.
+    Ret:
+*/
+static L_TARGET ("avx512f,avx512bw") void WriteClrARGB565BEAvx512 (uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    const __m512i mask = _mm512_broadcast_i32x4 (_mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    uint32_t i;
+
+    i = ARGB565RowAvx512 (out, in, n, mask);
+    WriteClrARGB565BE (&out[i * 3], &in[i * 4], n - i);
 }
+#endif
@@ -26,6 +26,8 @@ SOFTWARE.
 #define IMGCVT_H_INCLUDED
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 enum
 {
@@ -46,10 +48,24 @@ enum
     IMGCVT_ORI_270,
 };
 
+/* conversion phases timed by imgcvt_Stats_t */
+enum
+{
+    IMGCVT_PHASE_LOAD, // png file loading
+    IMGCVT_PHASE_PARSE, // png chunk parsing
+    IMGCVT_PHASE_INFLATE, // zlib decompression
+    IMGCVT_PHASE_UNFILTER, // scanline unfiltering and Adam7 deinterlacing
+    IMGCVT_PHASE_RGBA, // conversion of the png pixels to RGBA8888
+    IMGCVT_PHASE_PIXELS, // pixel traversal and conversion to the output format
+    IMGCVT_PHASE_WRITE, // output file opening and writing
+    IMGCVT_PHASE_NUM,
+};
+
 typedef enum
 {
     IMGCVT_OK = 0,
     IMGCVT_ERR,
+    IMGCVT_ERR_ARG, // invalid argument or context option
 } imgcvt_Result_e;
 
 typedef struct
@@ -63,6 +79,31 @@ typedef struct
     uint32_t pxl_offset;
 } imgcvt_Header_t;
 
+/* wall clock time and output bytes of every conversion phase */
+typedef struct
+{
+    double seconds[IMGCVT_PHASE_NUM];
+    uint64_t bytes[IMGCVT_PHASE_NUM];
+} imgcvt_Stats_t;
+
+/* conversion context: all the state of a conversion lives here, so different
+   contexts can be converted concurrently from different threads */
+typedef struct
+{
+    const char *in_fname; // input png file path
+    const char *out_fname; // output raw file path
+    int8_t clr_format; // output color format (IMGCVT_CLR_FORMAT_...)
+    int8_t ori; // output orientation (IMGCVT_ORI_...)
+    int8_t kernel; // forced conversion kernel variant, -1 picks the best one the cpu supports
+    const char *cache_dir; // conversion cache directory, NULL disables the cache
+    imgcvt_Stats_t *stats; // phase timing is added here, NULL disables it (builds with IMGCVT_STATS only)
+    uint16_t threads; // threads converting the pixels of a large image in bands, 1 converts on the calling thread
+    bool ignore_crc; // skip the png chunk CRC checks, for trusted inputs
+} imgcvt_Ctx_t;
+
+void imgcvt_CtxInit (imgcvt_Ctx_t *ctx);
+imgcvt_Result_e imgcvt_CtxConvert (const imgcvt_Ctx_t *ctx);
+imgcvt_Result_e imgcvt_ConvertMemory (const imgcvt_Ctx_t *ctx, const uint8_t *png, size_t pngSize, uint8_t **out, size_t *outSize);
 imgcvt_Result_e imgcvt_Convert (const char *inF, const char *outF, int8_t clrFormat, int8_t ori);
 
 #endif // IMGCVT_H_INCLUDED
@@ -113,6 +113,15 @@ void lodepng_free(void* ptr);
 #define LODEPNG_RESTRICT /* not available */
 #endif
 
+/* x86-64 SIMD code paths, compiled for their own target and picked at run time from the cpu features */
+#if defined(LODEPNG_COMPILE_CPU_DISPATCH) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LODEPNG_X86_SIMD
+#define LODEPNG_TARGET(isa) __attribute__((target(isa)))
+/*for code shared by variants that differ only by constant arguments*/
+#define LODEPNG_TARGET_INLINE(isa) __attribute__((target(isa), always_inline))
+#include <immintrin.h>
+#endif
+
 /* Replacements for C library functions such as memcpy and strlen, to support platforms
 where a full C library is not available. The compiler can recognize them and compile
 to something as fast. */
@@ -313,6 +322,51 @@ static unsigned ucvector_push_back(ucvector* p, unsigned char c) {
 }
 #endif /*defined(LODEPNG_COMPILE_PNG) || defined(LODEPNG_COMPILE_ENCODER)*/
 
+#ifdef LODEPNG_COMPILE_DECODER
+/*a piece of compressed data that is read where it is: the data of one IDAT chunk, or a whole buffer*/
+typedef struct InflatePiece {
+  const unsigned char* data;
+  size_t size;
+} InflatePiece;
+
+#ifdef LODEPNG_COMPILE_PNG
+/*dynamic vector of pieces*/
+typedef struct piecevector {
+  InflatePiece* data;
+  size_t size; /*number of pieces*/
+  size_t allocsize; /*allocated number of pieces*/
+  size_t datasize; /*sum of the sizes of the pieces*/
+} piecevector;
+
+static void piecevector_cleanup(piecevector* p) {
+  p->size = p->allocsize = p->datasize = 0;
+  lodepng_free(p->data);
+  p->data = NULL;
+}
+
+static void piecevector_init(piecevector* p) {
+  p->data = NULL;
+  p->size = p->allocsize = p->datasize = 0;
+}
+
+/*returns error code: 95 if the total size overflows, 83 if out of memory*/
+static unsigned piecevector_push_back(piecevector* p, const unsigned char* data, size_t size) {
+  if(lodepng_addofl(p->datasize, size, &p->datasize)) return 95;
+  if(p->size == p->allocsize) {
+    size_t newsize = p->allocsize ? p->allocsize * 2u : 4u;
+    void* pieces = lodepng_realloc(p->data, newsize * sizeof(InflatePiece));
+    if(!pieces) return 83; /*alloc fail*/
+    p->allocsize = newsize;
+    p->data = (InflatePiece*)pieces;
+  }
+  p->data[p->size].data = data;
+  p->data[p->size].size = size;
+  ++p->size;
+  return 0;
+}
+#endif /*LODEPNG_COMPILE_PNG*/
+#endif /*LODEPNG_COMPILE_DECODER*/
+
 
 /* ////////////////////////////////////////////////////////////////////////// */
 
@@ -475,26 +529,101 @@ static void writeBitsReversed(LodePNGBitWriter* writer, unsigned value, size_t n
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/*bytes a window of the bit reader keeps after the read position, unless the input ends before: enough for a
+whole length/distance pair and for the ensureBits lookahead*/
+#define READER_AHEAD 16u
+/*size of the copy of the bytes around the end of a piece*/
+#define READER_BRIDGE 64u
+
+/*
+Reads the input in pieces, where they are. The reader sees a window: a piece, or near the end of a piece a
+copy of the bytes around it in bridge. The window has at least READER_AHEAD bytes after the read position
+or is the end of the input, so reading in a window is the same as reading in the whole input in one buffer.
+Call LodePNGBitReader_window before every step that reads at most READER_AHEAD bytes.
+*/
 typedef struct {
-  const unsigned char* data;
-  size_t size; /*size of data in bytes*/
-  size_t bitsize; /*size of data in bits, end of valid bp values, should be 8*size*/
-  size_t bp;
+  const unsigned char* data; /*the window*/
+  size_t size; /*size of the window in bytes*/
+  size_t bitsize; /*size of the window in bits, end of valid bp values, should be 8*size*/
+  size_t bp; /*bit position in the window*/
   unsigned buffer; /*buffer for reading bits. NOTE: 'unsigned' must support at least 32 bits*/
+  size_t base; /*position of the window in the input*/
+  size_t limit; /*the window is moved when the byte position of bp gets past this*/
+  const InflatePiece* pieces;
+  size_t numpieces;
+  size_t piece; /*the piece with the byte at bp, or the last one*/
+  size_t piecestart; /*position of that piece in the input*/
+  size_t total; /*size of the input in bytes*/
+  unsigned char bridge[READER_BRIDGE];
 } LodePNGBitReader;
 
-/* data size argument is in bytes. Returns error if size too large causing overflow */
-static unsigned LodePNGBitReader_init(LodePNGBitReader* reader, const unsigned char* data, size_t size) {
+/*copy n bytes of the data of the pieces, skipping the first skip bytes of it, to out. Returns the number of
+bytes copied, which is less than n if the data ends before*/
+static size_t copyPieces(unsigned char* out, const InflatePiece* pieces, size_t numpieces, size_t skip, size_t n) {
+  size_t copied = 0;
+  size_t i;
+  for(i = 0; i != numpieces && copied != n; ++i) {
+    size_t num;
+    if(skip >= pieces[i].size) {
+      skip -= pieces[i].size;
+      continue;
+    }
+    num = LODEPNG_MIN(n - copied, pieces[i].size - skip);
+    lodepng_memcpy(out + copied, pieces[i].data + skip, num);
+    copied += num;
+    skip = 0;
+  }
+  return copied;
+}
+
+/*move the window to the byte at bp*/
+static void LodePNGBitReader_move(LodePNGBitReader* reader) {
+  size_t pos = reader->base + (reader->bp >> 3u); /*byte position in the input*/
+  size_t bits = reader->bp & 7u;
+  size_t end;
+  while(pos >= reader->piecestart + reader->pieces[reader->piece].size && reader->piece + 1u < reader->numpieces) {
+    reader->piecestart += reader->pieces[reader->piece].size;
+    ++reader->piece;
+  }
+  end = reader->piecestart + reader->pieces[reader->piece].size;
+  if(end - pos >= READER_AHEAD || end == reader->total) {
+    reader->data = reader->pieces[reader->piece].data;
+    reader->size = reader->pieces[reader->piece].size;
+    reader->base = reader->piecestart;
+  } else {
+    reader->size = copyPieces(reader->bridge, reader->pieces + reader->piece, reader->numpieces - reader->piece,
+                              pos - reader->piecestart, READER_BRIDGE);
+    reader->data = reader->bridge;
+    reader->base = pos;
+  }
+  reader->bitsize = reader->size * 8u;
+  reader->bp = ((pos - reader->base) << 3u) + bits;
+  reader->limit = reader->base + reader->size == reader->total ? (size_t)(-1) : reader->size - READER_AHEAD;
+}
+
+/*keeps READER_AHEAD bytes in the window after bp, or the end of the input*/
+static LODEPNG_INLINE void LodePNGBitReader_window(LodePNGBitReader* reader) {
+  if((reader->bp >> 3u) > reader->limit) LodePNGBitReader_move(reader);
+}
+
+/* the total size of the pieces is in bytes. Returns error if size too large causing overflow */
+static unsigned LodePNGBitReader_init(LodePNGBitReader* reader, const InflatePiece* pieces, size_t numpieces,
+                                      size_t size) {
   size_t temp;
-  reader->data = data;
-  reader->size = size;
+  reader->pieces = pieces;
+  reader->numpieces = numpieces;
+  reader->piece = 0;
+  reader->piecestart = 0;
+  reader->total = size;
+  reader->base = 0;
+  reader->bp = 0;
+  reader->buffer = 0;
   /* size in bits, return error if overflow (if size_t is 32 bit this supports up to 500MB)  */
-  if(lodepng_mulofl(size, 8u, &reader->bitsize)) return 105;
+  if(lodepng_mulofl(size, 8u, &temp)) return 105;
   /*ensure incremented bp can be compared to bitsize without overflow even when it would be incremented 32 too much and
   trying to ensure 32 more bits*/
-  if(lodepng_addofl(reader->bitsize, 64u, &temp)) return 105;
-  reader->bp = 0;
-  reader->buffer = 0;
+  if(lodepng_addofl(temp, 64u, &temp)) return 105;
+  LodePNGBitReader_move(reader);
   return 0; /*ok*/
 }
 
@@ -610,7 +739,10 @@ unsigned lode_png_test_bitreader(const unsigned char* data, size_t size,
                                  size_t numsteps, const size_t* steps, unsigned* result) {
   size_t i;
   LodePNGBitReader reader;
-  LodePNGBitReader_init(&reader, data, size);
+  InflatePiece piece;
+  piece.data = data;
+  piece.size = size;
+  LodePNGBitReader_init(&reader, &piece, 1, size);
   for(i = 0; i < numsteps; i++) {
     size_t step = steps[i];
     unsigned ok;
@@ -625,11 +757,14 @@ unsigned lode_png_test_bitreader(const unsigned char* data, size_t size,
 }
 #endif /*LODEPNG_COMPILE_DECODER*/
 
-static unsigned reverseBits(unsigned bits, unsigned num) {
-  /*TODO: implement faster lookup table based version when needed*/
-  unsigned i, result = 0;
-  for(i = 0; i < num; i++) result |= ((bits >> (num - i - 1u)) & 1u) << i;
-  return result;
+/*num is at most 16*/
+static LODEPNG_INLINE unsigned reverseBits(unsigned bits, unsigned num) {
+  /*reverse the 16 low bits by swapping ever larger groups of them, then drop the 16 - num low ones*/
+  bits = ((bits & 0x5555u) << 1u) | ((bits >> 1u) & 0x5555u);
+  bits = ((bits & 0x3333u) << 2u) | ((bits >> 2u) & 0x3333u);
+  bits = ((bits & 0x0f0fu) << 4u) | ((bits >> 4u) & 0x0f0fu);
+  bits = ((bits & 0x00ffu) << 8u) | ((bits >> 8u) & 0x00ffu);
+  return bits >> (16u - num);
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -823,12 +958,9 @@ static unsigned HuffmanTree_makeTable(HuffmanTree* tree) {
   return 0;
 }
 
-/*
-Second step for the ...makeFromLengths and ...makeFromFrequencies functions.
-numcodes, lengths and maxbitlen must already be filled in correctly. return
-value is error.
-*/
-static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree) {
+/*make the codes of a tree from its code lengths, numcodes, lengths and maxbitlen
+must already be filled in correctly. return value is error.*/
+static unsigned HuffmanTree_makeCodes(HuffmanTree* tree) {
   unsigned* blcount;
   unsigned* nextcode;
   unsigned error = 0;
@@ -859,11 +991,21 @@ static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree) {
 
   lodepng_free(blcount);
   lodepng_free(nextcode);
+  return error;
+}
 
+/*
+Second step for the ...makeFromLengths and ...makeFromFrequencies functions.
+numcodes, lengths and maxbitlen must already be filled in correctly. return
+value is error.
+*/
+static unsigned HuffmanTree_makeFromLengths2(HuffmanTree* tree) {
+  unsigned error = HuffmanTree_makeCodes(tree);
   if(!error) error = HuffmanTree_makeTable(tree);
   return error;
 }
 
+#ifdef LODEPNG_COMPILE_DECODER
 /*
 given the code lengths (as stored in the PNG file), generate the tree as defined
 by Deflate. maxbitlen is the maximum bits that a code in the tree can have.
@@ -879,6 +1021,34 @@ static unsigned HuffmanTree_makeFromLengths(HuffmanTree* tree, const unsigned* b
   tree->maxbitlen = maxbitlen;
   return HuffmanTree_makeFromLengths2(tree);
 }
+#endif /*LODEPNG_COMPILE_DECODER*/
+
+/*
+like HuffmanTree_makeFromLengths, but only the codes are made, without the
+tables of huffmanDecodeSymbol: for the encoder and for the trees inflate decodes
+with its packed tables. The lengths get the check HuffmanTree_makeTable does, a
+tree of 2 symbols or more must use every bit combination exactly once.
+return value is error.
+*/
+static unsigned HuffmanTree_makeCodesFromLengths(HuffmanTree* tree, const unsigned* bitlen,
+                                                 size_t numcodes, unsigned maxbitlen) {
+  unsigned i, numpresent = 0;
+  unsigned long space = 0; /*share of the bit combinations the codes take, out of 1 << maxbitlen*/
+  for(i = 0; i != numcodes; ++i) {
+    if(bitlen[i] == 0) continue;
+    if(bitlen[i] > maxbitlen) return 55; /*invalid tree: code longer than allowed*/
+    space += 1ul << (maxbitlen - bitlen[i]);
+    ++numpresent;
+  }
+  /*oversubscribed or incomplete huffman tree*/
+  if(numpresent >= 2 && space != (1ul << maxbitlen)) return 55;
+  tree->lengths = (unsigned*)lodepng_malloc(numcodes * sizeof(unsigned));
+  if(!tree->lengths) return 83; /*alloc fail*/
+  for(i = 0; i != numcodes; ++i) tree->lengths[i] = bitlen[i];
+  tree->numcodes = (unsigned)numcodes; /*number of symbols*/
+  tree->maxbitlen = maxbitlen;
+  return HuffmanTree_makeCodes(tree);
+}
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
@@ -1091,7 +1261,7 @@ static unsigned generateFixedLitLenTree(HuffmanTree* tree) {
   for(i = 256; i <= 279; ++i) bitlen[i] = 7;
   for(i = 280; i <= 287; ++i) bitlen[i] = 8;
 
-  error = HuffmanTree_makeFromLengths(tree, bitlen, NUM_DEFLATE_CODE_SYMBOLS, 15);
+  error = HuffmanTree_makeCodesFromLengths(tree, bitlen, NUM_DEFLATE_CODE_SYMBOLS, 15);
 
   lodepng_free(bitlen);
   return error;
@@ -1105,7 +1275,7 @@ static unsigned generateFixedDistanceTree(HuffmanTree* tree) {
 
   /*there are 32 distance codes, but 30-31 are unused*/
   for(i = 0; i != NUM_DISTANCE_SYMBOLS; ++i) bitlen[i] = 5;
-  error = HuffmanTree_makeFromLengths(tree, bitlen, NUM_DISTANCE_SYMBOLS, 15);
+  error = HuffmanTree_makeCodesFromLengths(tree, bitlen, NUM_DISTANCE_SYMBOLS, 15);
 
   lodepng_free(bitlen);
   return error;
@@ -1139,6 +1309,285 @@ static unsigned huffmanDecodeSymbol(LodePNGBitReader* reader, const HuffmanTree*
 /* / Inflator (Decompressor)                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
+/*the deflate sliding window: back references reach at most this many bytes back*/
+#define INFLATE_WINDOW_SIZE 32768u
+/*streaming inflate hands out the data once this many bytes are in the out buffer*/
+#define INFLATE_SINK_SIZE 262144u
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len);
+
+/*like memmove: dst and src may overlap*/
+static void lodepng_memmove(void* dst, const void* src, size_t size) {
+  size_t i;
+  if((char*)dst < (const char*)src) {
+    for(i = 0; i < size; i++) ((char*)dst)[i] = ((const char*)src)[i];
+  } else {
+    for(i = size; i > 0; i--) ((char*)dst)[i - 1] = ((const char*)src)[i - 1];
+  }
+}
+
+/*Receives the inflated data in pieces while inflating, so the out buffer only has to hold the sliding
+window plus the data not handed out yet, instead of the whole decompressed stream.*/
+typedef struct InflateSink {
+  /*called with every new piece of data, in order. Returns error code, 0 to continue*/
+  unsigned (*consume)(void* context, const unsigned char* data, size_t size);
+  void* context;
+  size_t flushed; /*bytes at the start of the out buffer already handed out*/
+  unsigned adler; /*adler32 of all the data handed out*/
+} InflateSink;
+
+/*hand out the new data at the end of the out buffer, then keep only the sliding window in it*/
+static unsigned inflateSinkFlush(ucvector* out, size_t* pos, InflateSink* sink) {
+  unsigned error = 0;
+  if(*pos > sink->flushed) {
+    sink->adler = update_adler32(sink->adler, out->data + sink->flushed, (unsigned)(*pos - sink->flushed));
+    error = sink->consume(sink->context, out->data + sink->flushed, *pos - sink->flushed);
+  }
+  if(*pos > INFLATE_WINDOW_SIZE) {
+    lodepng_memmove(out->data, out->data + *pos - INFLATE_WINDOW_SIZE, INFLATE_WINDOW_SIZE);
+    *pos = out->size = INFLATE_WINDOW_SIZE;
+  }
+  sink->flushed = *pos;
+  return error;
+}
+
+/* ////////////////////////////////////////////////////////////////////////// */
+/* / Inflator fast loop                                                     / */
+/* ////////////////////////////////////////////////////////////////////////// */
+
+/*
+The fast loop decodes with packed tables: one lookup gives a whole symbol, up to
+two literals, or a length or distance with its base value and number of extra
+bits, so only the extra bits themselves remain to be read. Codes longer than
+the root bits continue in a secondary table. Table entry bits:
+0-4: bits consumed by the entry, 5-7: INFLATE_KIND_ value,
+8-15: first literal, number of extra bits, or secondary table bits,
+16-31: second literal, base value, or secondary table start.
+*/
+#define INFLATE_LL_ROOTBITS 11u /*root bits of the literal/length table, 2 literals fit in it often*/
+#define INFLATE_D_ROOTBITS 8u /*root bits of the distance table*/
+#define INFLATE_KIND_BASE 0u /*length or distance code*/
+#define INFLATE_KIND_LIT1 1u /*one literal*/
+#define INFLATE_KIND_LIT2 2u /*two literals*/
+#define INFLATE_KIND_SUB 3u /*the code continues in a secondary table*/
+#define INFLATE_KIND_END 4u /*end code*/
+#define INFLATE_KIND_INVALID 5u /*disallowed huffman symbol*/
+#define INFLATE_KIND_INVALID_D 6u /*distance code 30 or 31*/
+/*room the fast loop needs in the out buffer: the longest match plus the overrun of copying it by words*/
+#define INFLATE_FAST_OUT (258u + 16u)
+/*largest packed tables: the root plus at most one secondary table of up to 15 - rootbits bits per symbol*/
+#define INFLATE_LL_TABLESIZE ((1u << INFLATE_LL_ROOTBITS) + NUM_DEFLATE_CODE_SYMBOLS * (1u << (15u - INFLATE_LL_ROOTBITS)))
+#define INFLATE_D_TABLESIZE ((1u << INFLATE_D_ROOTBITS) + NUM_DISTANCE_SYMBOLS * (1u << (15u - INFLATE_D_ROOTBITS)))
+
+#define INFLATE_ENTRY(kind, bits, low, high) ((bits) | ((kind) << 5u) | ((low) << 8u) | ((unsigned)(high) << 16u))
+#define INFLATE_ENTRY_BITS(entry) ((entry) & 31u)
+#define INFLATE_ENTRY_KIND(entry) (((entry) >> 5u) & 7u)
+#define INFLATE_ENTRY_LOW(entry) (((entry) >> 8u) & 255u)
+#define INFLATE_ENTRY_HIGH(entry) ((entry) >> 16u)
+
+/*read and write 8 bytes as a little endian word, where size_t has 64 bits. Written out byte by byte so the
+compiler makes a single load or store of them, the split shifts keep 32 bit targets free of warnings*/
+static LODEPNG_INLINE size_t lodepng_read64bitLE(const unsigned char* p) {
+  return (size_t)p[0] | ((size_t)p[1] << 8u) | ((size_t)p[2] << 16u) | ((size_t)p[3] << 24u) |
+         ((((size_t)p[4] | ((size_t)p[5] << 8u) | ((size_t)p[6] << 16u) | ((size_t)p[7] << 24u)) << 16u) << 16u);
+}
+
+static LODEPNG_INLINE void lodepng_write64bitLE(unsigned char* p, size_t value) {
+  size_t high = (value >> 16u) >> 16u;
+  p[0] = (unsigned char)value;
+  p[1] = (unsigned char)(value >> 8u);
+  p[2] = (unsigned char)(value >> 16u);
+  p[3] = (unsigned char)(value >> 24u);
+  p[4] = (unsigned char)high;
+  p[5] = (unsigned char)(high >> 8u);
+  p[6] = (unsigned char)(high >> 16u);
+  p[7] = (unsigned char)(high >> 24u);
+}
+
+/*the table entry of a symbol with a code of the given number of bits*/
+static unsigned inflateSymbolEntry(unsigned symbol, unsigned bits, unsigned litlen) {
+  if(symbol == INVALIDSYMBOL) return INFLATE_ENTRY(INFLATE_KIND_INVALID, bits, 0u, 0u);
+  if(!litlen) {
+    if(symbol > 29) return INFLATE_ENTRY(INFLATE_KIND_INVALID_D, bits, 0u, 0u);
+    return INFLATE_ENTRY(INFLATE_KIND_BASE, bits, DISTANCEEXTRA[symbol], DISTANCEBASE[symbol]);
+  }
+  if(symbol <= 255) return INFLATE_ENTRY(INFLATE_KIND_LIT1, bits, symbol, 0u);
+  if(symbol == 256) return INFLATE_ENTRY(INFLATE_KIND_END, bits, 0u, 0u);
+  if(symbol > LAST_LENGTH_CODE_INDEX) return INFLATE_ENTRY(INFLATE_KIND_INVALID, bits, 0u, 0u);
+  return INFLATE_ENTRY(INFLATE_KIND_BASE, bits, LENGTHEXTRA[symbol - FIRST_LENGTH_CODE_INDEX],
+                       LENGTHBASE[symbol - FIRST_LENGTH_CODE_INDEX]);
+}
+
+/*make the packed table of a huffman tree checked by HuffmanTree_makeCodesFromLengths, in t which has room
+for INFLATE_LL_TABLESIZE or INFLATE_D_TABLESIZE entries. litlen: 1 for the literal/length tree, 0 for the
+distance tree.*/
+static void inflateMakeTable(unsigned* t, const HuffmanTree* tree, unsigned rootbits, unsigned litlen) {
+  size_t headsize = (size_t)1u << rootbits;
+  size_t i, j, pointer;
+  unsigned numpresent = 0;
+
+  /*secondary table sizes, as in HuffmanTree_makeTable: the longest code of each root index, kept in the
+  root entries until they are filled in*/
+  for(i = 0; i != headsize; ++i) t[i] = 0;
+  for(i = 0; i != tree->numcodes; ++i) {
+    unsigned l = tree->lengths[i];
+    unsigned index;
+    if(l != 0) ++numpresent;
+    if(l <= rootbits) continue;
+    index = reverseBits(tree->codes[i] >> (l - rootbits), rootbits);
+    t[index] = LODEPNG_MAX(t[index], l);
+  }
+  pointer = headsize;
+  for(i = 0; i != headsize; ++i) {
+    if(t[i] > rootbits) {
+      t[i] = INFLATE_ENTRY(INFLATE_KIND_SUB, rootbits, t[i] - rootbits, pointer);
+      pointer += (size_t)1u << INFLATE_ENTRY_LOW(t[i]);
+    } else if(numpresent < 2) {
+      /*bit combinations no code uses (trees with less than 2 symbols, whose codes are 1 bit long) decode to
+      an invalid symbol. Larger trees are complete, their codes fill every entry*/
+      t[i] = inflateSymbolEntry(INVALIDSYMBOL, 1u, litlen);
+    }
+  }
+
+  for(i = 0; i != tree->numcodes; ++i) {
+    unsigned l = tree->lengths[i];
+    unsigned reverse = reverseBits(tree->codes[i], l);
+    unsigned entry;
+    size_t num;
+    if(l == 0) continue;
+    if(l <= rootbits) {
+      entry = inflateSymbolEntry((unsigned)i, l, litlen);
+      num = (size_t)1u << (rootbits - l);
+      for(j = 0; j != num; ++j) t[reverse | (j << l)] = entry;
+    } else {
+      unsigned head = t[reverse & (headsize - 1u)];
+      unsigned subbits = INFLATE_ENTRY_LOW(head);
+      unsigned* sub = t + INFLATE_ENTRY_HIGH(head) + (reverse >> rootbits);
+      entry = inflateSymbolEntry((unsigned)i, l - rootbits, litlen);
+      num = (size_t)1u << (subbits - (l - rootbits));
+      for(j = 0; j != num; ++j) sub[j << (l - rootbits)] = entry;
+    }
+  }
+
+  if(litlen) {
+    /*merge a literal with the literal following it when both codes fit in the root bits. Going down, the
+    entry of the following bits (a lower index) is still a single literal. Without branches, which would be
+    mispredicted about every other entry*/
+    for(i = headsize; i-- > 0;) {
+      unsigned first = t[i];
+      unsigned second = t[i >> INFLATE_ENTRY_BITS(first)];
+      unsigned bits = INFLATE_ENTRY_BITS(first) + INFLATE_ENTRY_BITS(second);
+      unsigned merge = (INFLATE_ENTRY_KIND(first) == INFLATE_KIND_LIT1) & (INFLATE_ENTRY_KIND(second) == INFLATE_KIND_LIT1)
+                     & (bits <= rootbits);
+      unsigned lit2 = INFLATE_ENTRY(INFLATE_KIND_LIT2, bits, INFLATE_ENTRY_LOW(first), INFLATE_ENTRY_LOW(second));
+      t[i] = merge ? lit2 : first;
+    }
+  }
+}
+
+/*
+Decodes symbols of a huffman block for as long as a whole length/distance pair can be read from a single
+word of input and written in the out buffer without checks: with a 64 bit word that is every symbol but
+those of the last bytes of input. Stops at the end code (sets *done), on error, or once *pos reaches
+outlimit, the caller decodes the rest. Does nothing on targets where size_t is less than 64 bits.
+*/
+static unsigned inflateHuffmanFast(ucvector* out, size_t* pos, LodePNGBitReader* reader,
+                                   const unsigned* table_ll, const unsigned* table_d,
+                                   size_t outlimit, unsigned* done) {
+  const unsigned char* in = reader->data;
+  size_t bp = reader->bp;
+  size_t p = *pos;
+  unsigned char* data = out->data;
+  unsigned error = 0;
+
+  /*15 + 5 bits of length and 15 + 13 bits of distance, all from one word holding at least 57 bits*/
+  if(sizeof(size_t) < 8 || reader->size < 8) return 0;
+
+  while((bp >> 3u) <= reader->size - 8u && p < outlimit) {
+    size_t bits, length, distance;
+    unsigned entry, extra;
+
+    if(p + INFLATE_FAST_OUT > out->allocsize) {
+      if(!ucvector_resize(out, p + INFLATE_FAST_OUT)) ERROR_BREAK(83 /*alloc fail*/);
+      data = out->data;
+    }
+
+    bits = lodepng_read64bitLE(in + (bp >> 3u)) >> (bp & 7u);
+    entry = table_ll[bits & ((1u << INFLATE_LL_ROOTBITS) - 1u)];
+    if(INFLATE_ENTRY_KIND(entry) == INFLATE_KIND_SUB) {
+      bits >>= INFLATE_LL_ROOTBITS;
+      bp += INFLATE_LL_ROOTBITS;
+      entry = table_ll[INFLATE_ENTRY_HIGH(entry) + (bits & ((1u << INFLATE_ENTRY_LOW(entry)) - 1u))];
+    }
+    bits >>= INFLATE_ENTRY_BITS(entry);
+    bp += INFLATE_ENTRY_BITS(entry);
+
+    if(INFLATE_ENTRY_KIND(entry) == INFLATE_KIND_LIT1) {
+      data[p++] = (unsigned char)INFLATE_ENTRY_LOW(entry);
+      continue;
+    } else if(INFLATE_ENTRY_KIND(entry) == INFLATE_KIND_LIT2) {
+      data[p] = (unsigned char)INFLATE_ENTRY_LOW(entry);
+      data[p + 1] = (unsigned char)INFLATE_ENTRY_HIGH(entry);
+      p += 2;
+      continue;
+    } else if(INFLATE_ENTRY_KIND(entry) == INFLATE_KIND_END) {
+      *done = 1;
+      break;
+    } else if(INFLATE_ENTRY_KIND(entry) != INFLATE_KIND_BASE) {
+      ERROR_BREAK(16); /*error: tried to read disallowed huffman symbol*/
+    }
+
+    /*length code: base and extra bits*/
+    extra = INFLATE_ENTRY_LOW(entry);
+    length = INFLATE_ENTRY_HIGH(entry) + (bits & ((1u << extra) - 1u));
+    bits >>= extra;
+    bp += extra;
+
+    /*distance code*/
+    entry = table_d[bits & ((1u << INFLATE_D_ROOTBITS) - 1u)];
+    if(INFLATE_ENTRY_KIND(entry) == INFLATE_KIND_SUB) {
+      bits >>= INFLATE_D_ROOTBITS;
+      bp += INFLATE_D_ROOTBITS;
+      entry = table_d[INFLATE_ENTRY_HIGH(entry) + (bits & ((1u << INFLATE_ENTRY_LOW(entry)) - 1u))];
+    }
+    if(INFLATE_ENTRY_KIND(entry) == INFLATE_KIND_INVALID_D) {
+      ERROR_BREAK(18); /*error: invalid distance code (30-31 are never used)*/
+    } else if(INFLATE_ENTRY_KIND(entry) != INFLATE_KIND_BASE) {
+      ERROR_BREAK(16); /*error: tried to read disallowed huffman symbol*/
+    }
+    bits >>= INFLATE_ENTRY_BITS(entry);
+    bp += INFLATE_ENTRY_BITS(entry);
+    extra = INFLATE_ENTRY_LOW(entry);
+    distance = INFLATE_ENTRY_HIGH(entry) + (bits & ((1u << extra) - 1u));
+    bp += extra;
+
+    if(distance > p) ERROR_BREAK(52); /*too long backward distance*/
+    {
+      unsigned char* dst = data + p;
+      const unsigned char* src = dst - distance;
+      const unsigned char* end = dst + length;
+      if(distance >= 8) {
+        /*a word at a time, the last word may write past the match into the free room*/
+        do {
+          lodepng_write64bitLE(dst, lodepng_read64bitLE(src));
+          dst += 8;
+          src += 8;
+        } while(dst < end);
+      } else if(distance == 1) {
+        lodepng_memset(dst, *src, length);
+      } else {
+        while(dst < end) *dst++ = *src++;
+      }
+    }
+    p += length;
+  }
+
+  reader->bp = bp;
+  *pos = p;
+  out->size = p;
+  return error;
+}
+
 /*get the tree of a deflated block with fixed tree, as specified in the deflate specification
 Returns error code.*/
 static unsigned getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d) {
@@ -1202,6 +1651,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     i = 0;
     while(i < HLIT + HDIST) {
       unsigned code;
+      LodePNGBitReader_window(reader);
       ensureBits25(reader, 22); /* up to 15 bits for huffman code, up to 7 extra bits below*/
       code = huffmanDecodeSymbol(reader, &tree_cl);
       if(code <= 15) /*a length code*/ {
@@ -1265,9 +1715,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     if(bitlen_ll[256] == 0) ERROR_BREAK(64); /*the length of the end code 256 must be larger than 0*/
 
     /*now we've finally got HLIT and HDIST, so generate the code trees, and the function is done*/
-    error = HuffmanTree_makeFromLengths(tree_ll, bitlen_ll, NUM_DEFLATE_CODE_SYMBOLS, 15);
+    error = HuffmanTree_makeCodesFromLengths(tree_ll, bitlen_ll, NUM_DEFLATE_CODE_SYMBOLS, 15);
     if(error) break;
-    error = HuffmanTree_makeFromLengths(tree_d, bitlen_d, NUM_DISTANCE_SYMBOLS, 15);
+    error = HuffmanTree_makeCodesFromLengths(tree_d, bitlen_d, NUM_DISTANCE_SYMBOLS, 15);
 
     break; /*end of error-while*/
   }
@@ -1280,39 +1730,129 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   return error;
 }
 
-/*inflate a block with dynamic of fixed Huffman tree. btype must be 1 or 2.*/
-static unsigned inflateHuffmanBlock(ucvector* out, size_t* pos, LodePNGBitReader* reader,
-                                    unsigned btype) {
-  unsigned error = 0;
-  HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
-  HuffmanTree tree_d; /*the huffman tree for distance codes*/
+/*the memory of a LodePNGDecoderScratch, a single allocation starting with this header*/
+typedef struct InflateScratch {
+  unsigned* fixed_table_ll; /*packed tables of the blocks with fixed tree*/
+  unsigned* fixed_table_d;
+  unsigned* table_ll; /*room for the packed tables of a block with dynamic tree*/
+  unsigned* table_d;
+} InflateScratch;
+
+unsigned lodepng_scratch_init(LodePNGDecoderScratch* scratch) {
+  unsigned error;
+  HuffmanTree tree_ll, tree_d;
+  InflateScratch* s = (InflateScratch*)lodepng_malloc(sizeof(InflateScratch)
+      + 2 * (INFLATE_LL_TABLESIZE + INFLATE_D_TABLESIZE) * sizeof(unsigned));
+  scratch->data = 0;
+  if(!s) return 83; /*alloc fail*/
+  s->fixed_table_ll = (unsigned*)(s + 1);
+  s->fixed_table_d = s->fixed_table_ll + INFLATE_LL_TABLESIZE;
+  s->table_ll = s->fixed_table_d + INFLATE_D_TABLESIZE;
+  s->table_d = s->table_ll + INFLATE_LL_TABLESIZE;
 
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
+  error = getTreeInflateFixed(&tree_ll, &tree_d);
+  if(!error) {
+    inflateMakeTable(s->fixed_table_ll, &tree_ll, INFLATE_LL_ROOTBITS, 1);
+    inflateMakeTable(s->fixed_table_d, &tree_d, INFLATE_D_ROOTBITS, 0);
+    scratch->data = s;
+  } else {
+    lodepng_free(s);
+  }
+  HuffmanTree_cleanup(&tree_ll);
+  HuffmanTree_cleanup(&tree_d);
+  return error;
+}
+
+void lodepng_scratch_cleanup(LodePNGDecoderScratch* scratch) {
+  lodepng_free(scratch->data);
+  scratch->data = 0;
+}
 
-  if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
-  else /*if(btype == 2)*/ error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
+/*decode a symbol with a packed table, the bit reader must already have been ensured at least 15 bits.
+Returns the table entry of the symbol.*/
+static unsigned inflateDecodeEntry(LodePNGBitReader* reader, const unsigned* table, unsigned rootbits) {
+  unsigned entry = table[peekBits(reader, rootbits)];
+  if(INFLATE_ENTRY_KIND(entry) == INFLATE_KIND_SUB) {
+    advanceBits(reader, rootbits);
+    entry = table[INFLATE_ENTRY_HIGH(entry) + peekBits(reader, INFLATE_ENTRY_LOW(entry))];
+  }
+  advanceBits(reader, INFLATE_ENTRY_BITS(entry));
+  return entry;
+}
+
+/*inflate a block with dynamic of fixed Huffman tree. btype must be 1 or 2.
+scratch may be NULL, the tables are then made in memory of this block.*/
+static unsigned inflateHuffmanBlock(ucvector* out, size_t* pos, LodePNGBitReader* reader,
+                                    unsigned btype, InflateSink* sink, const LodePNGDecoderScratch* scratch) {
+  unsigned error = 0;
+  InflateScratch* s = scratch ? (InflateScratch*)scratch->data : 0;
+  unsigned* tables = 0; /*allocated for this block when there is no scratch*/
+  unsigned* table_ll = 0; /*packed table for literal and length codes*/
+  unsigned* table_d = 0; /*packed table for distance codes*/
+
+  if(btype == 1 && s) {
+    table_ll = s->fixed_table_ll;
+    table_d = s->fixed_table_d;
+  } else {
+    HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
+    HuffmanTree tree_d; /*the huffman tree for distance codes*/
+    HuffmanTree_init(&tree_ll);
+    HuffmanTree_init(&tree_d);
+    if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
+    else /*if(btype == 2)*/ error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
+    if(!error && s) {
+      table_ll = s->table_ll;
+      table_d = s->table_d;
+    } else if(!error) {
+      tables = (unsigned*)lodepng_malloc((INFLATE_LL_TABLESIZE + INFLATE_D_TABLESIZE) * sizeof(unsigned));
+      if(!tables) error = 83; /*alloc fail*/
+      else {
+        table_ll = tables;
+        table_d = tables + INFLATE_LL_TABLESIZE;
+      }
+    }
+    if(!error) {
+      inflateMakeTable(table_ll, &tree_ll, INFLATE_LL_ROOTBITS, 1);
+      inflateMakeTable(table_d, &tree_d, INFLATE_D_ROOTBITS, 0);
+    }
+    HuffmanTree_cleanup(&tree_ll);
+    HuffmanTree_cleanup(&tree_d);
+  }
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/ {
-    /*code_ll is literal, length or end code*/
-    unsigned code_ll;
+    /*entry_ll is a literal, two literals, a length or the end code*/
+    unsigned entry_ll;
+    unsigned done = 0;
+    if(sink && *pos >= INFLATE_SINK_SIZE) {
+      error = inflateSinkFlush(out, pos, sink);
+      if(error) break;
+    }
+    /*most symbols, then one at a time below near the end of the window*/
+    LodePNGBitReader_window(reader);
+    error = inflateHuffmanFast(out, pos, reader, table_ll, table_d, sink ? INFLATE_SINK_SIZE : (size_t)(-1), &done);
+    if(error || done) break;
+    if(sink && *pos >= INFLATE_SINK_SIZE) continue;
+    LodePNGBitReader_window(reader);
     ensureBits25(reader, 20); /* up to 15 for the huffman symbol, up to 5 for the length extra bits */
-    code_ll = huffmanDecodeSymbol(reader, &tree_ll);
-    if(code_ll <= 255) /*literal symbol*/ {
-      /*ucvector_push_back would do the same, but for some reason the two lines below run 10% faster*/
-      if(!ucvector_resize(out, (*pos) + 1)) ERROR_BREAK(83 /*alloc fail*/);
-      out->data[*pos] = (unsigned char)code_ll;
-      ++(*pos);
-    } else if(code_ll >= FIRST_LENGTH_CODE_INDEX && code_ll <= LAST_LENGTH_CODE_INDEX) /*length code*/ {
-      unsigned code_d, distance;
+    entry_ll = inflateDecodeEntry(reader, table_ll, INFLATE_LL_ROOTBITS);
+    if(INFLATE_ENTRY_KIND(entry_ll) == INFLATE_KIND_LIT1 || INFLATE_ENTRY_KIND(entry_ll) == INFLATE_KIND_LIT2) {
+      size_t num = INFLATE_ENTRY_KIND(entry_ll) == INFLATE_KIND_LIT2 ? 2 : 1;
+      if(!ucvector_resize(out, (*pos) + num)) ERROR_BREAK(83 /*alloc fail*/);
+      out->data[*pos] = (unsigned char)INFLATE_ENTRY_LOW(entry_ll);
+      if(num == 2) out->data[*pos + 1] = (unsigned char)INFLATE_ENTRY_HIGH(entry_ll);
+      *pos += num;
+    } else if(INFLATE_ENTRY_KIND(entry_ll) == INFLATE_KIND_BASE) /*length code*/ {
+      unsigned entry_d, distance;
       unsigned numextrabits_l, numextrabits_d; /*extra bits for length and distance*/
       size_t start, backward, length;
 
       /*part 1: get length base*/
-      length = LENGTHBASE[code_ll - FIRST_LENGTH_CODE_INDEX];
+      length = INFLATE_ENTRY_HIGH(entry_ll);
 
       /*part 2: get extra bits and add the value of that to length*/
-      numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
+      numextrabits_l = INFLATE_ENTRY_LOW(entry_ll);
       if(numextrabits_l != 0) {
         /* bits already ensured above */
         length += readBits(reader, numextrabits_l);
@@ -1320,18 +1860,16 @@ static unsigned inflateHuffmanBlock(ucvector* out, size_t* pos, LodePNGBitReader
 
       /*part 3: get distance code*/
       ensureBits32(reader, 28); /* up to 15 for the huffman symbol, up to 13 for the extra bits */
-      code_d = huffmanDecodeSymbol(reader, &tree_d);
-      if(code_d > 29) {
-        if(code_d <= 31) {
-          ERROR_BREAK(18); /*error: invalid distance code (30-31 are never used)*/
-        } else /* if(code_d == INVALIDSYMBOL) */{
-          ERROR_BREAK(16); /*error: tried to read disallowed huffman symbol*/
-        }
+      entry_d = inflateDecodeEntry(reader, table_d, INFLATE_D_ROOTBITS);
+      if(INFLATE_ENTRY_KIND(entry_d) == INFLATE_KIND_INVALID_D) {
+        ERROR_BREAK(18); /*error: invalid distance code (30-31 are never used)*/
+      } else if(INFLATE_ENTRY_KIND(entry_d) != INFLATE_KIND_BASE) {
+        ERROR_BREAK(16); /*error: tried to read disallowed huffman symbol*/
       }
-      distance = DISTANCEBASE[code_d];
+      distance = INFLATE_ENTRY_HIGH(entry_d);
 
       /*part 4: get extra bits from distance*/
-      numextrabits_d = DISTANCEEXTRA[code_d];
+      numextrabits_d = INFLATE_ENTRY_LOW(entry_d);
       if(numextrabits_d != 0) {
         /* bits already ensured above */
         distance += readBits(reader, numextrabits_d);
@@ -1354,9 +1892,9 @@ static unsigned inflateHuffmanBlock(ucvector* out, size_t* pos, LodePNGBitReader
         lodepng_memcpy(out->data + *pos, out->data + backward, length);
         *pos += length;
       }
-    } else if(code_ll == 256) {
+    } else if(INFLATE_ENTRY_KIND(entry_ll) == INFLATE_KIND_END) {
       break; /*end code, break the loop*/
-    } else /*if(code_ll == INVALIDSYMBOL)*/ {
+    } else /*if(INFLATE_ENTRY_KIND(entry_ll) == INFLATE_KIND_INVALID)*/ {
       ERROR_BREAK(16); /*error: tried to read disallowed huffman symbol*/
     }
     /*check if any of the ensureBits above went out of bounds*/
@@ -1368,8 +1906,7 @@ static unsigned inflateHuffmanBlock(ucvector* out, size_t* pos, LodePNGBitReader
     }
   }
 
-  HuffmanTree_cleanup(&tree_ll);
-  HuffmanTree_cleanup(&tree_d);
+  lodepng_free(tables);
 
   return error;
 }
@@ -1396,9 +1933,15 @@ static unsigned inflateNoCompression(ucvector* out, size_t* pos,
   if(!ucvector_resize(out, (*pos) + LEN)) return 83; /*alloc fail*/
 
   /*read the literal data: LEN bytes are now stored in the out buffer*/
-  if(bytepos + LEN > size) return 23; /*error: reading outside of in buffer*/
+  if(reader->base + bytepos + LEN > reader->total) return 23; /*error: reading outside of in buffer*/
 
-  lodepng_memcpy(out->data + *pos, reader->data + bytepos, LEN);
+  if(bytepos + LEN <= size) {
+    lodepng_memcpy(out->data + *pos, reader->data + bytepos, LEN);
+  } else {
+    /*the data goes on in the next pieces*/
+    copyPieces(out->data + *pos, reader->pieces + reader->piece, reader->numpieces - reader->piece,
+               reader->base + bytepos - reader->piecestart, LEN);
+  }
   *pos += LEN;
   bytepos += LEN;
 
@@ -1407,26 +1950,26 @@ static unsigned inflateNoCompression(ucvector* out, size_t* pos,
   return error;
 }
 
-static unsigned lodepng_inflatev(ucvector* out,
-                                 const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings) {
+/*inflate from the position of the reader. sink may be NULL to inflate everything in out, otherwise out only
+keeps the sliding window*/
+static unsigned lodepng_inflatev(ucvector* out, LodePNGBitReader* reader,
+                                 const LodePNGDecompressSettings* settings, InflateSink* sink) {
   unsigned BFINAL = 0;
   size_t pos = 0; /*byte position in the out buffer*/
-  LodePNGBitReader reader;
-  unsigned error = LodePNGBitReader_init(&reader, in, insize);
-
-  if(error) return error;
+  unsigned error = 0;
 
   while(!BFINAL) {
     unsigned BTYPE;
-    if(!ensureBits9(&reader, 3)) return 52; /*error, bit pointer will jump past memory*/
-    BFINAL = readBits(&reader, 1);
-    BTYPE = readBits(&reader, 2);
+    LodePNGBitReader_window(reader);
+    if(!ensureBits9(reader, 3)) return 52; /*error, bit pointer will jump past memory*/
+    BFINAL = readBits(reader, 1);
+    BTYPE = readBits(reader, 2);
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, &pos, &reader, settings); /*no compression*/
-    else error = inflateHuffmanBlock(out, &pos, &reader, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, &pos, reader, settings); /*no compression*/
+    else error = inflateHuffmanBlock(out, &pos, reader, BTYPE, sink, settings->scratch); /*compression, BTYPE 01 or 10*/
 
+    if(!error && sink && (BFINAL || pos >= INFLATE_SINK_SIZE)) error = inflateSinkFlush(out, &pos, sink);
     if(error) return error;
   }
 
@@ -1436,10 +1979,16 @@ static unsigned lodepng_inflatev(ucvector* out,
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGDecompressSettings* settings) {
-  unsigned error;
   ucvector v;
+  LodePNGBitReader reader;
+  InflatePiece piece;
+  unsigned error;
+  piece.data = in;
+  piece.size = insize;
+  error = LodePNGBitReader_init(&reader, &piece, 1, insize);
+  if(error) return error;
   ucvector_init_buffer(&v, *out, *outsize);
-  error = lodepng_inflatev(&v, in, insize, settings);
+  error = lodepng_inflatev(&v, &reader, settings, NULL);
   *out = v.data;
   *outsize = v.size;
   return error;
@@ -2154,10 +2703,97 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
+#ifdef LODEPNG_X86_SIMD
+/*The vector versions add up blocks of 16 or 32 bytes: s1 grows by the sum of the bytes, s2 by
+the block size times s1 plus the bytes weighted by their distance from the block end. The
+sums of bytes come from sad against zero, the weighted sums from maddubs, and the s1 seen
+before each block is accumulated in ps to be scaled once per run of blocks. Runs are short
+enough that no 32 bit sum overflows before the modulo, like the 5552 bytes of the scalar loop.
+Both handle the whole blocks of data and return the number of bytes done.*/
+LODEPNG_TARGET("ssse3")
+static unsigned update_adler32_ssse3(unsigned* s1, unsigned* s2, const unsigned char* data, unsigned len) {
+  const __m128i weights = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i zero = _mm_setzero_si128();
+  unsigned done = 0;
+
+  while(len - done >= 16u) {
+    unsigned blocks = (len - done) / 16u;
+    unsigned b;
+    __m128i vs1 = zero, vps = zero, vs2 = zero;
+    if(blocks > 5552u / 16u) blocks = 5552u / 16u;
+    for(b = 0; b != blocks; ++b) {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)(data + done + b * 16u));
+      vps = _mm_add_epi32(vps, vs1);
+      vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(bytes, zero));
+      vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_maddubs_epi16(bytes, weights), ones));
+    }
+    /*horizontal sums*/
+    vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(1, 0, 3, 2)));
+    vps = _mm_add_epi32(vps, _mm_shuffle_epi32(vps, _MM_SHUFFLE(1, 0, 3, 2)));
+    vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(1, 0, 3, 2)));
+    vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(2, 3, 0, 1)));
+    *s2 += *s1 * blocks * 16u + (unsigned)_mm_cvtsi128_si32(vps) * 16u + (unsigned)_mm_cvtsi128_si32(vs2);
+    *s1 += (unsigned)_mm_cvtsi128_si32(vs1);
+    *s1 %= 65521u;
+    *s2 %= 65521u;
+    done += blocks * 16u;
+  }
+  return done;
+}
+
+LODEPNG_TARGET("avx2")
+static unsigned update_adler32_avx2(unsigned* s1, unsigned* s2, const unsigned char* data, unsigned len) {
+  const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                           16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m256i ones = _mm256_set1_epi16(1);
+  const __m256i zero = _mm256_setzero_si256();
+  unsigned done = 0;
+
+  while(len - done >= 32u) {
+    unsigned blocks = (len - done) / 32u;
+    unsigned b;
+    __m256i vs1 = zero, vps = zero, vs2 = zero;
+    __m128i s1sum, pssum, s2sum;
+    if(blocks > 5552u / 32u) blocks = 5552u / 32u;
+    for(b = 0; b != blocks; ++b) {
+      __m256i bytes = _mm256_loadu_si256((const __m256i*)(data + done + b * 32u));
+      vps = _mm256_add_epi32(vps, vs1);
+      vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(bytes, zero));
+      vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+    }
+    /*horizontal sums*/
+    s1sum = _mm_add_epi32(_mm256_castsi256_si128(vs1), _mm256_extracti128_si256(vs1, 1));
+    pssum = _mm_add_epi32(_mm256_castsi256_si128(vps), _mm256_extracti128_si256(vps, 1));
+    s2sum = _mm_add_epi32(_mm256_castsi256_si128(vs2), _mm256_extracti128_si256(vs2, 1));
+    s1sum = _mm_add_epi32(s1sum, _mm_shuffle_epi32(s1sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    pssum = _mm_add_epi32(pssum, _mm_shuffle_epi32(pssum, _MM_SHUFFLE(1, 0, 3, 2)));
+    s2sum = _mm_add_epi32(s2sum, _mm_shuffle_epi32(s2sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    s2sum = _mm_add_epi32(s2sum, _mm_shuffle_epi32(s2sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    *s2 += *s1 * blocks * 32u + (unsigned)_mm_cvtsi128_si32(pssum) * 32u + (unsigned)_mm_cvtsi128_si32(s2sum);
+    *s1 += (unsigned)_mm_cvtsi128_si32(s1sum);
+    *s1 %= 65521u;
+    *s2 %= 65521u;
+    done += blocks * 32u;
+  }
+  return done;
+}
+#endif /*LODEPNG_X86_SIMD*/
+
 static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
   unsigned s1 = adler & 0xffffu;
   unsigned s2 = (adler >> 16u) & 0xffffu;
 
+#ifdef LODEPNG_X86_SIMD
+  if(len >= 64u) {
+    unsigned done = 0;
+    if(__builtin_cpu_supports("avx2")) done = update_adler32_avx2(&s1, &s2, data, len);
+    else if(__builtin_cpu_supports("ssse3")) done = update_adler32_ssse3(&s1, &s2, data, len);
+    data += done;
+    len -= done;
+  }
+#endif /*LODEPNG_X86_SIMD*/
+
   while(len != 0u) {
     unsigned i;
     /*at least 5552 sums can be done before the sums overflow, saving a lot of module divisions*/
@@ -2185,9 +2821,8 @@ static unsigned adler32(const unsigned char* data, unsigned len) {
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                 size_t insize, const LodePNGDecompressSettings* settings) {
-  unsigned error = 0;
+/*check the 2 byte zlib header, returns error code*/
+static unsigned zlib_check_header(const unsigned char* in, size_t insize) {
   unsigned CM, CINFO, FDICT;
 
   if(insize < 2) return 53; /*error, size of zlib data too small*/
@@ -2212,6 +2847,13 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
       "The additional flags shall not specify a preset dictionary."*/
     return 26;
   }
+  return 0;
+}
+
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings) {
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
 
   error = inflate(out, outsize, in + 2, insize - 2, settings);
   if(error) return error;
@@ -2234,6 +2876,45 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
   }
 }
 
+/*decompress a zlib stream made of pieces with the built in inflator, reading them where they are. With sink the
+data is handed to it in parts instead of returned in out, out may then be NULL. custom_zlib and custom_inflate
+are not used.*/
+static unsigned zlib_decompress_pieces(ucvector* out, const InflatePiece* pieces, size_t numpieces, size_t insize,
+                                       const LodePNGDecompressSettings* settings, InflateSink* sink) {
+  LodePNGBitReader reader;
+  ucvector v;
+  unsigned error;
+
+  if(insize < 2) return 53; /*error, size of zlib data too small*/
+  error = LodePNGBitReader_init(&reader, pieces, numpieces, insize);
+  if(error) return error;
+  /*the window holds the whole header*/
+  error = zlib_check_header(reader.data, reader.size);
+  if(error) return error;
+  reader.bp = 16;
+
+  if(sink) {
+    ucvector_init_buffer(&v, NULL, 0);
+    sink->flushed = 0;
+    sink->adler = 1u;
+    error = lodepng_inflatev(&v, &reader, settings, sink);
+    lodepng_free(v.data);
+  } else {
+    error = lodepng_inflatev(out, &reader, settings, NULL);
+  }
+  if(error) return error;
+
+  if(!settings->ignore_adler32) {
+    unsigned char adler[4];
+    unsigned checksum = sink ? sink->adler : adler32(out->data, (unsigned)out->size);
+    if(insize < 4) return 58; /*error, no room for the checksum*/
+    copyPieces(adler, pieces, numpieces, insize - 4, 4);
+    if(checksum != lodepng_read32bitInt(adler)) return 58; /*error, adler checksum not correct, data must be corrupted*/
+  }
+
+  return 0; /*no error*/
+}
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -2341,9 +3022,10 @@ void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings) {
   settings->custom_zlib = 0;
   settings->custom_inflate = 0;
   settings->custom_context = 0;
+  settings->scratch = 0;
 }
 
-const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0, 0};
+const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0, 0, 0};
 
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -2361,8 +3043,10 @@ const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0,
 
 
 #ifndef LODEPNG_NO_COMPILE_CRC
-/* CRC polynomial: 0xedb88320 */
-static unsigned lodepng_crc32_table[256] = {
+/* CRC polynomial: 0xedb88320. Table 0 is the classic byte at a time table, table k advances
+the CRC of a byte followed by k zero bytes, for processing 8 bytes at a time (slicing-by-8)*/
+static const unsigned lodepng_crc32_table[8][256] = {
+  {
            0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
    249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
    498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
@@ -2395,14 +3079,346 @@ static unsigned lodepng_crc32_table[256] = {
   2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
   3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
   3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
+  },
+  {
+           0u,  421212481u,  842424962u,  724390851u, 1684849924u, 2105013317u, 1448781702u, 1329698503u,
+  3369699848u, 3519200073u, 4210026634u, 3824474571u, 2897563404u, 3048111693u, 2659397006u, 2274893007u,
+  1254232657u, 1406739216u, 2029285587u, 1643069842u,  783210325u,  934667796u,  479770071u,   92505238u,
+  2182846553u, 2600511768u, 2955803355u, 2838940570u, 3866582365u, 4285295644u, 3561045983u, 3445231262u,
+  2508465314u, 2359236067u, 2813478432u, 3198777185u, 4058571174u, 3908292839u, 3286139684u, 3670389349u,
+  1566420650u, 1145479147u, 1869335592u, 1987116393u,  959540142u,  539646703u,  185010476u,  303839341u,
+  3745920755u, 3327985586u, 3983561841u, 4100678960u, 3140154359u, 2721170102u, 2300350837u, 2416418868u,
+   396344571u,  243568058u,  631889529u, 1018359608u, 1945336319u, 1793607870u, 1103436669u, 1490954812u,
+  4034481925u, 3915546180u, 3259968903u, 3679722694u, 2484439553u, 2366552896u, 2787371139u, 3208174018u,
+   950060301u,  565965900u,  177645455u,  328046286u, 1556873225u, 1171730760u, 1861902987u, 2011255754u,
+  3132841300u, 2745199637u, 2290958294u, 2442530455u, 3738671184u, 3352078609u, 3974232786u, 4126854035u,
+  1919080284u, 1803150877u, 1079293406u, 1498383519u,  370020952u,  253043481u,  607678682u, 1025720731u,
+  1711106983u, 2095471334u, 1472923941u, 1322268772u,   26324643u,  411738082u,  866634785u,  717028704u,
+  2904875439u, 3024081134u, 2668790573u, 2248782444u, 3376948395u, 3495106026u, 4219356713u, 3798300520u,
+   792689142u,  908347575u,  487136116u,   68299317u, 1263779058u, 1380486579u, 2036719216u, 1618931505u,
+  3890672638u, 4278043327u, 3587215740u, 3435896893u, 2206873338u, 2593195963u, 2981909624u, 2829542713u,
+   998479947u,  580430090u,  162921161u,  279890824u, 1609522511u, 1190423566u, 1842954189u, 1958874764u,
+  4082766403u, 3930137346u, 3245109441u, 3631694208u, 2536953671u, 2385372678u, 2768287173u, 3155920004u,
+  1900120602u, 1750776667u, 1131931800u, 1517083097u,  355290910u,  204897887u,  656092572u, 1040194781u,
+  3113746450u, 2692952403u, 2343461520u, 2461357009u, 3723805974u, 3304059991u, 4022511508u, 4141455061u,
+  2919742697u, 3072101800u, 2620513899u, 2234183466u, 3396041197u, 3547351212u, 4166851439u, 3779471918u,
+  1725839073u, 2143618976u, 1424512099u, 1307796770u,   45282277u,  464110244u,  813994343u,  698327078u,
+  3838160568u, 4259225593u, 3606301754u, 3488152955u, 2158586812u, 2578602749u, 2996767038u, 2877569151u,
+   740041904u,  889656817u,  506086962u,  120682355u, 1215357364u, 1366020341u, 2051441462u, 1667084919u,
+  3422213966u, 3538019855u, 4190942668u, 3772220557u, 2945847882u, 3062702859u, 2644537544u, 2226864521u,
+    52649286u,  439905287u,  823476164u,  672009861u, 1733269570u, 2119477507u, 1434057408u, 1281543041u,
+  2167981343u, 2552493150u, 3004082077u, 2853541596u, 3847487515u, 4233048410u, 3613549209u, 3464057816u,
+  1239502615u, 1358593622u, 2077699477u, 1657543892u,  764250643u,  882293586u,  532408465u,  111204816u,
+  1585378284u, 1197851309u, 1816695150u, 1968414767u,  974272232u,  587794345u,  136598634u,  289367339u,
+  2527558116u, 2411481253u, 2760973158u, 3179948583u, 4073438432u, 3956313505u, 3237863010u, 3655790371u,
+   347922877u,  229101820u,  646611775u, 1066513022u, 1892689081u, 1774917112u, 1122387515u, 1543337850u,
+  3697634229u, 3313392372u, 3998419255u, 4148705398u, 3087642289u, 2702352368u, 2319436851u, 2468674930u
+  },
+  {
+           0u,   29518391u,   59036782u,   38190681u,  118073564u,  114017003u,   76381362u,   89069189u,
+   236147128u,  265370511u,  228034006u,  206958561u,  152762724u,  148411219u,  178138378u,  190596925u,
+   472294256u,  501532999u,  530741022u,  509615401u,  456068012u,  451764635u,  413917122u,  426358261u,
+   305525448u,  334993663u,  296822438u,  275991697u,  356276756u,  352202787u,  381193850u,  393929805u,
+   944588512u,  965684439u, 1003065998u,  973863097u, 1061482044u, 1049003019u, 1019230802u, 1023561829u,
+   912136024u,  933002607u,  903529270u,  874031361u,  827834244u,  815125939u,  852716522u,  856752605u,
+   611050896u,  631869351u,  669987326u,  640506825u,  593644876u,  580921211u,  551983394u,  556069653u,
+   712553512u,  733666847u,  704405574u,  675154545u,  762387700u,  749958851u,  787859610u,  792175277u,
+  1889177024u, 1901651959u, 1931368878u, 1927033753u, 2006131996u, 1985040171u, 1947726194u, 1976933189u,
+  2122964088u, 2135668303u, 2098006038u, 2093965857u, 2038461604u, 2017599123u, 2047123658u, 2076625661u,
+  1824272048u, 1836991623u, 1866005214u, 1861914857u, 1807058540u, 1786244187u, 1748062722u, 1777547317u,
+  1655668488u, 1668093247u, 1630251878u, 1625932113u, 1705433044u, 1684323811u, 1713505210u, 1742760333u,
+  1222101792u, 1226154263u, 1263738702u, 1251046777u, 1339974652u, 1310460363u, 1281013650u, 1301863845u,
+  1187289752u, 1191637167u, 1161842422u, 1149379777u, 1103966788u, 1074747507u, 1112139306u, 1133218845u,
+  1425107024u, 1429406311u, 1467333694u, 1454888457u, 1408811148u, 1379576507u, 1350309090u, 1371438805u,
+  1524775400u, 1528845279u, 1499917702u, 1487177649u, 1575719220u, 1546255107u, 1584350554u, 1605185389u,
+  3778354048u, 3774312887u, 3803303918u, 3816007129u, 3862737756u, 3892238699u, 3854067506u, 3833203973u,
+  4012263992u, 4007927823u, 3970080342u, 3982554209u, 3895452388u, 3924658387u, 3953866378u, 3932773565u,
+  4245928176u, 4241609415u, 4271336606u, 4283762345u, 4196012076u, 4225268251u, 4187931714u, 4166823541u,
+  4076923208u, 4072833919u, 4035198246u, 4047918865u, 4094247316u, 4123732899u, 4153251322u, 4132437965u,
+  3648544096u, 3636082519u, 3673983246u, 3678331705u, 3732010428u, 3753090955u, 3723829714u, 3694611429u,
+  3614117080u, 3601426159u, 3572488374u, 3576541825u, 3496125444u, 3516976691u, 3555094634u, 3525581405u,
+  3311336976u, 3298595879u, 3336186494u, 3340255305u, 3260503756u, 3281337595u, 3251864226u, 3222399125u,
+  3410866088u, 3398419871u, 3368647622u, 3372945905u, 3427010420u, 3448139075u, 3485520666u, 3456284973u,
+  2444203584u, 2423127159u, 2452308526u, 2481530905u, 2527477404u, 2539934891u, 2502093554u, 2497740997u,
+  2679949304u, 2659102159u, 2620920726u, 2650438049u, 2562027300u, 2574714131u, 2603727690u, 2599670141u,
+  2374579504u, 2353749767u, 2383274334u, 2412743529u, 2323684844u, 2336421851u, 2298759554u, 2294686645u,
+  2207933576u, 2186809023u, 2149495014u, 2178734801u, 2224278612u, 2236720739u, 2266437690u, 2262135309u,
+  2850214048u, 2820717207u, 2858812622u, 2879680249u, 2934667388u, 2938704459u, 2909776914u, 2897069605u,
+  2817622296u, 2788420399u, 2759153014u, 2780249921u, 2700618180u, 2704950259u, 2742877610u, 2730399645u,
+  3049550800u, 3020298727u, 3057690558u, 3078802825u, 2999835404u, 3004150075u, 2974355298u, 2961925461u,
+  3151438440u, 3121956959u, 3092510214u, 3113327665u, 3168701108u, 3172786307u, 3210370778u, 3197646061u
+  },
+  {
+           0u, 3099354981u, 2852767883u,  313896942u, 2405603159u,  937357362u,  627793884u, 2648127673u,
+  3316918511u, 2097696650u, 1874714724u, 3607201537u, 1255587768u, 4067088605u, 3772741427u, 1482887254u,
+  1343838111u, 3903140090u, 4195393300u, 1118632049u, 3749429448u, 1741137837u, 1970407491u, 3452858150u,
+  2511175536u,  756094997u, 1067759611u, 2266550430u,  449832999u, 2725482306u, 2965774508u,  142231497u,
+  2687676222u,  412010587u,  171665333u, 2995192016u,  793786473u, 2548850444u, 2237264098u, 1038456711u,
+  1703315409u, 3711623348u, 3482275674u, 1999841343u, 3940814982u, 1381529571u, 1089329165u, 4166106984u,
+  4029413537u, 1217896388u, 1512189994u, 3802027855u, 2135519222u, 3354724499u, 3577784189u, 1845280792u,
+   899665998u, 2367928107u, 2677414085u,  657096608u, 3137160985u,   37822588u,  284462994u, 2823350519u,
+  2601801789u,  598228824u,  824021174u, 2309093331u,  343330666u, 2898962447u, 3195996129u,  113467524u,
+  1587572946u, 3860600759u, 4104763481u, 1276501820u, 3519211397u, 1769898208u, 2076913422u, 3279374443u,
+  3406630818u, 1941006535u, 1627703081u, 3652755532u, 1148164341u, 4241751952u, 3999682686u, 1457141531u,
+   247015245u, 3053797416u, 2763059142u,  470583459u, 2178658330u,  963106687u,  735213713u, 2473467892u,
+   992409347u, 2207944806u, 2435792776u,  697522413u, 3024379988u,  217581361u,  508405983u, 2800865210u,
+  4271038444u, 1177467017u, 1419450215u, 3962007554u, 1911572667u, 3377213406u, 3690561584u, 1665525589u,
+  1799331996u, 3548628985u, 3241568279u, 2039091058u, 3831314379u, 1558270126u, 1314193216u, 4142438437u,
+  2928380019u,  372764438u,   75645176u, 3158189981u,  568925988u, 2572515393u, 2346768303u,  861712586u,
+  3982079547u, 1441124702u, 1196457648u, 4293663189u, 1648042348u, 3666298377u, 3358779879u, 1888390786u,
+   686661332u, 2421291441u, 2196002399u,  978858298u, 2811169155u,  523464422u,  226935048u, 3040519789u,
+  3175145892u,  100435649u,  390670639u, 2952089162u,  841119475u, 2325614998u, 2553003640u,  546822429u,
+  2029308235u, 3225988654u, 3539796416u, 1782671013u, 4153826844u, 1328167289u, 1570739863u, 3844338162u,
+  1298864389u, 4124540512u, 3882013070u, 1608431339u, 3255406162u, 2058742071u, 1744848601u, 3501990332u,
+  2296328682u,  811816591u,  584513889u, 2590678532u,  129869501u, 3204563416u, 2914283062u,  352848211u,
+   494030490u, 2781751807u, 3078325777u,  264757620u, 2450577869u,  715964072u,  941166918u, 2158327331u,
+  3636881013u, 1618608400u, 1926213374u, 3396585883u, 1470427426u, 4011365959u, 4255988137u, 1158766284u,
+  1984818694u, 3471935843u, 3695453837u, 1693991400u, 4180638033u, 1100160564u, 1395044826u, 3952793279u,
+  3019491049u,  189112716u,  435162722u, 2706139399u, 1016811966u, 2217162459u, 2526189877u,  774831696u,
+   643086745u, 2666061564u, 2354934034u,  887166583u, 2838900430u,  294275499u,   54519365u, 3145957664u,
+  3823145334u, 1532818963u, 1240029693u, 4048895640u, 1820460577u, 3560857924u, 3331051178u, 2117577167u,
+  3598663992u, 1858283101u, 2088143283u, 3301633750u, 1495127663u, 3785470218u, 4078182116u, 1269332353u,
+   332098007u, 2876706482u, 3116540252u,   25085497u, 2628386432u,  605395429u,  916469259u, 2384220526u,
+  2254837415u, 1054503362u,  745528876u, 2496903497u,  151290352u, 2981684885u, 2735556987u,  464596510u,
+  1137851976u, 4218313005u, 3923506883u, 1365741990u, 3434129695u, 1946996346u, 1723425172u, 3724871409u
+  },
+  {
+           0u, 1029712304u, 2059424608u, 1201699536u, 4118849216u, 3370159984u, 2403399072u, 2988497936u,
+   812665793u,  219177585u, 1253054625u, 2010132753u, 3320900865u, 4170237105u, 3207642721u, 2186319825u,
+  1625331586u, 1568718386u,  438355170u,  658566482u, 2506109250u, 2818578674u, 4020265506u, 3535817618u,
+  1351670851u, 1844508147u,  709922595u,  389064339u, 2769320579u, 2557498163u, 3754961379u, 3803185235u,
+  3250663172u, 4238411444u, 3137436772u, 2254525908u,  876710340u,  153198708u, 1317132964u, 1944187668u,
+  4054934725u, 3436268917u, 2339452837u, 3054575125u,   70369797u,  961670069u, 2129760613u, 1133623509u,
+  2703341702u, 2621542710u, 3689016294u, 3867263574u, 1419845190u, 1774270454u,  778128678u,  318858390u,
+  2438067015u, 2888948471u, 3952189479u, 3606153623u, 1691440519u, 1504803895u,  504432359u,  594620247u,
+  1492342857u, 1704161785u,  573770537u,  525542041u, 2910060169u, 2417219385u, 3618876905u, 3939730521u,
+  1753420680u, 1440954936u,  306397416u,  790849880u, 2634265928u, 2690882808u, 3888375336u, 3668168600u,
+   940822475u,   91481723u, 1121164459u, 2142483739u, 3448989963u, 4042473659u, 3075684971u, 2318603227u,
+   140739594u,  889433530u, 1923340138u, 1338244826u, 4259521226u, 3229813626u, 2267247018u, 3124975642u,
+  2570221389u, 2756861693u, 3824297005u, 3734113693u, 1823658381u, 1372780605u,  376603373u,  722643805u,
+  2839690380u, 2485261628u, 3548540908u, 4007806556u, 1556257356u, 1638052860u,  637716780u,  459464860u,
+  4191346895u, 3300051327u, 2199040943u, 3195181599u,  206718479u,  825388991u, 1989285231u, 1274166495u,
+  3382881038u, 4106388158u, 3009607790u, 2382549470u, 1008864718u,   21111934u, 1189240494u, 2072147742u,
+  2984685714u, 2357631266u, 3408323570u, 4131834434u, 1147541074u, 2030452706u, 1051084082u,   63335554u,
+  2174155603u, 3170292451u, 4216760371u, 3325460867u, 1947622803u, 1232499747u,  248909555u,  867575619u,
+  3506841360u, 3966111392u, 2881909872u, 2527485376u,  612794832u,  434546784u, 1581699760u, 1663499008u,
+  3782634705u, 3692447073u, 2612412337u, 2799048193u,  351717905u,  697754529u, 1849071985u, 1398190273u,
+  1881644950u, 1296545318u,  182963446u,  931652934u, 2242328918u, 3100053734u, 4284967478u, 3255255942u,
+  1079497815u, 2100821479u,  983009079u,  133672583u, 3050795671u, 2293717799u, 3474399735u, 4067887175u,
+   281479188u,  765927844u, 1778867060u, 1466397380u, 3846680276u, 3626469220u, 2676489652u, 2733102084u,
+   548881365u,  500656741u, 1517752501u, 1729575173u, 3577210133u, 3898068133u, 2952246901u, 2459410373u,
+  3910527195u, 3564487019u, 2480257979u, 2931134987u,  479546907u,  569730987u, 1716854139u, 1530213579u,
+  3647316762u, 3825568426u, 2745561210u, 2663766474u,  753206746u,  293940330u, 1445287610u, 1799716618u,
+  2314567513u, 3029685993u, 4080348217u, 3461678473u, 2088098201u, 1091956777u,  112560889u, 1003856713u,
+  3112514712u, 2229607720u, 3276105720u, 4263857736u, 1275433560u, 1902492648u,  918929720u,  195422344u,
+   685033439u,  364179055u, 1377080511u, 1869921551u, 3713294623u, 3761522863u, 2811507327u, 2599689167u,
+   413436958u,  633644462u, 1650777982u, 1594160846u, 3978570462u, 3494118254u, 2548332990u, 2860797966u,
+  1211387997u, 1968470509u,  854852413u,  261368461u, 3182753437u, 2161434413u, 3346310653u, 4195650637u,
+  2017729436u, 1160000044u,   42223868u, 1071931724u, 2378480988u, 2963576044u, 4144295484u, 3395602316u
+  },
+  {
+           0u, 3411858341u, 1304994059u, 2257875630u, 2609988118u, 1355649459u, 3596215069u,  486879416u,
+  3964895853u,  655315400u, 2711298918u, 1791488195u, 2009251963u, 3164476382u,  973758832u, 4048990933u,
+    64357019u, 3364540734u, 1310630800u, 2235723829u, 2554806413u, 1394316072u, 3582976390u,  517157411u,
+  4018503926u,  618222419u, 2722963965u, 1762783832u, 1947517664u, 3209171269u,  970744811u, 4068520014u,
+   128714038u, 3438335635u, 1248109629u, 2167961496u, 2621261600u, 1466012805u, 3522553387u,  447296910u,
+  3959392091u,  547575038u, 2788632144u, 1835791861u, 1886307661u, 3140622056u, 1034314822u, 4143626211u,
+    75106221u, 3475428360u, 1236444838u, 2196665603u, 2682996155u, 1421317662u, 3525567664u,  427767573u,
+  3895035328u,  594892389u, 2782995659u, 1857943406u, 1941489622u, 3101955187u, 1047553757u, 4113347960u,
+   257428076u, 3288652233u, 1116777319u, 2311878850u, 2496219258u, 1603640287u, 3640781169u,  308099796u,
+  3809183745u,  676813732u, 2932025610u, 1704983215u, 2023410199u, 3016104370u,  894593820u, 4262377657u,
+   210634999u, 3352484690u, 1095150076u, 2316991065u, 2535410401u, 1547934020u, 3671583722u,  294336591u,
+  3772615322u,  729897279u, 2903845777u, 1716123700u, 2068629644u, 2953845545u,  914647431u, 4258839074u,
+   150212442u, 3282623743u, 1161604689u, 2388688372u, 2472889676u, 1480171241u, 3735940167u,  368132066u,
+  3836185911u,  805002898u, 2842635324u, 1647574937u, 2134298401u, 3026852996u,  855535146u, 4188192143u,
+   186781121u, 3229539940u, 1189784778u, 2377547631u, 2427670487u, 1542429810u, 3715886812u,  371670393u,
+  3882979244u,  741170185u, 2864262823u, 1642462466u, 2095107514u, 3082559007u,  824732849u, 4201955092u,
+   514856152u, 3589064573u, 1400419795u, 2552522358u, 2233554638u, 1316849003u, 3370776517u,   62202976u,
+  4075001525u,  968836368u, 3207280574u, 1954014235u, 1769133219u, 2720925446u,  616199592u, 4024870413u,
+   493229635u, 3594175974u, 1353627464u, 2616354029u, 2264355925u, 1303087088u, 3409966430u,    6498043u,
+  4046820398u,  979978123u, 3170710821u, 2007099008u, 1789187640u, 2717386141u,  661419827u, 3962610838u,
+   421269998u, 3527459403u, 1423225061u, 2676515648u, 2190300152u, 1238466653u, 3477467891u,   68755798u,
+  4115633027u, 1041448998u, 3095868040u, 1943789869u, 1860096405u, 2776760880u,  588673182u, 3897205563u,
+   449450869u, 3516317904u, 1459794558u, 2623431131u, 2170245475u, 1242006214u, 3432247400u,  131015629u,
+  4137259288u, 1036337853u, 3142660115u, 1879958454u, 1829294862u, 2790523051u,  549483013u, 3952910752u,
+   300424884u, 3669282065u, 1545650111u, 2541513754u, 2323209378u, 1092980487u, 3350330793u,  216870412u,
+  4256931033u,  921128828u, 2960342482u, 2066738807u, 1714085583u, 2910195050u,  736264132u, 3770592353u,
+   306060335u, 3647131530u, 1610005796u, 2494197377u, 2309971513u, 1123257756u, 3295149874u,  255536279u,
+  4268596802u,  892423655u, 3013951305u, 2029645036u, 1711070292u, 2929725425u,  674528607u, 3815288570u,
+   373562242u, 3709388839u, 1535949449u, 2429577516u, 2379569556u, 1183418929u, 3223189663u,  188820282u,
+  4195850735u,  827017802u, 3084859620u, 2089020225u, 1636228089u, 2866415708u,  743340786u, 3876759895u,
+   361896217u, 3738094268u, 1482340370u, 2466671543u, 2382584591u, 1163888810u, 3284924932u,  144124321u,
+  4190215028u,  849168593u, 3020503679u, 2136336858u, 1649465698u, 2836138695u,  798521449u, 3838094284u
+  },
+  {
+           0u, 2792819636u, 2543784233u,  837294749u, 4098827283u, 1379413927u, 1674589498u, 3316072078u,
+   871321191u, 2509784531u, 2758827854u,   34034938u, 3349178996u, 1641505216u, 1346337629u, 4131942633u,
+  1742642382u, 3249117050u, 4030828007u, 1446413907u, 2475800797u,  904311657u,   68069876u, 2725880384u,
+  1412551337u, 4064729373u, 3283010432u, 1708771380u, 2692675258u,  101317902u,  937551763u, 2442587175u,
+  3485284764u, 1774858792u, 1478633653u, 4266992385u, 1005723023u, 2642744891u, 2892827814u,  169477906u,
+  4233263099u, 1512406095u, 1808623314u, 3451546982u,  136139752u, 2926205020u, 2676114113u,  972376437u,
+  2825102674u,  236236518u, 1073525883u, 2576072655u, 1546420545u, 4200303349u, 3417542760u, 1841601500u,
+  2609703733u, 1039917185u,  202635804u, 2858742184u, 1875103526u, 3384067218u, 4166835727u, 1579931067u,
+  1141601657u, 3799809741u, 3549717584u, 1977839588u, 2957267306u,  372464350u,  668680259u, 2175552503u,
+  2011446046u, 3516084394u, 3766168119u, 1175200131u, 2209029901u,  635180217u,  338955812u, 2990736784u,
+   601221559u, 2242044419u, 3024812190u,  306049834u, 3617246628u, 1911408144u, 1074125965u, 3866285881u,
+   272279504u, 3058543716u, 2275784441u,  567459149u, 3832906691u, 1107462263u, 1944752874u, 3583875422u,
+  2343980261u,  767641425u,  472473036u, 3126744696u, 2147051766u, 3649987394u, 3899029983u, 1309766251u,
+  3092841090u,  506333494u,  801510315u, 2310084639u, 1276520081u, 3932237093u, 3683203000u, 2113813516u,
+  3966292011u, 1243601823u, 2079834370u, 3716205238u,  405271608u, 3192979340u, 2411259153u,  701492901u,
+  3750207052u, 2045810168u, 1209569125u, 4000285905u,  734575199u, 2378150379u, 3159862134u,  438345922u,
+  2283203314u,  778166598u,  529136603u, 3120492655u, 2086260449u, 3660498261u, 3955679176u, 1303499900u,
+  3153699989u,  495890209u,  744928700u, 2316418568u, 1337360518u, 3921775410u, 3626602927u, 2120129051u,
+  4022892092u, 1237286280u, 2018993941u, 3726666913u,  461853231u, 3186645403u, 2350400262u,  711936178u,
+  3693557851u, 2052076527u, 1270360434u, 3989775046u,  677911624u, 2384402428u, 3220639073u,  427820757u,
+  1202443118u, 3789347034u, 3493118535u, 1984154099u, 3018127229u,  362020041u,  612099668u, 2181885408u,
+  1950653705u, 3526596285u, 3822816288u, 1168934804u, 2148251930u,  645706414u,  395618355u, 2984485767u,
+   544559008u, 2248295444u, 3085590153u,  295523645u, 3560598451u, 1917673479u, 1134918298u, 3855773998u,
+   328860103u, 3052210803u, 2214924526u,  577903450u, 3889505748u, 1101147744u, 1883911421u, 3594338121u,
+  3424493451u, 1785369663u, 1535282850u, 4260726038u,  944946072u, 2653270060u, 2949491377u,  163225861u,
+  4294103532u, 1501944408u, 1752023237u, 3457862513u,  196998655u, 2915761739u, 2619532502u,  978710370u,
+  2881684293u,  229902577u, 1012666988u, 2586515928u, 1603020630u, 4193987810u, 3356702335u, 1852063179u,
+  2553040162u, 1046169238u,  263412747u, 2848217023u, 1818454321u, 3390333573u, 4227627032u, 1569420204u,
+    60859927u, 2782375331u, 2487203646u,  843627658u, 4159668740u, 1368951216u, 1617990445u, 3322386585u,
+   810543216u, 2520310724u, 2815490393u,   27783917u, 3288386659u, 1652017111u, 1402985802u, 4125677310u,
+  1685994201u, 3255382381u, 4091620336u, 1435902020u, 2419138250u,  910562686u,  128847843u, 2715354199u,
+  1469150398u, 4058414858u, 3222168983u, 1719234083u, 2749255853u,   94984985u,  876691844u, 2453031472u
+  },
+  {
+           0u, 3433693342u, 1109723005u, 2391738339u, 2219446010u, 1222643300u, 3329165703u,  180685081u,
+  3555007413u,  525277995u, 2445286600u, 1567235158u, 1471092047u, 2600801745u,  361370162u, 3642757804u,
+  2092642603u, 2953916853u, 1050555990u, 4063508168u, 4176560081u,  878395215u, 3134470316u, 1987983410u,
+  2942184094u, 1676945920u, 3984272867u,  567356797u,  722740324u, 3887998202u, 1764827929u, 2778407815u,
+  4185285206u,  903635656u, 3142804779u, 2012833205u, 2101111980u, 2979425330u, 1058630609u, 4088621903u,
+   714308067u, 3862526333u, 1756790430u, 2753330688u, 2933487385u, 1651734407u, 3975966820u,  542535930u,
+  2244825981u, 1231508451u, 3353891840u,  188896414u,   25648519u, 3442302233u, 1134713594u, 2399689316u,
+  1445480648u, 2592229462u,  336416693u, 3634843435u, 3529655858u,  516441772u, 2420588879u, 1559052753u,
+   698204909u, 3845636723u, 1807271312u, 2803025166u, 2916600855u, 1635634313u, 4025666410u,  593021940u,
+  4202223960u,  919787974u, 3093159461u, 1962401467u, 2117261218u, 2996361020u, 1008193759u, 4038971457u,
+  1428616134u, 2576151384u,  386135227u, 3685348389u, 3513580860u,  499580322u, 2471098945u, 1608776415u,
+  2260985971u, 1248454893u, 3303468814u,  139259792u,   42591881u, 3458459159u, 1085071860u, 2349261162u,
+  3505103035u,  474062885u, 2463016902u, 1583654744u, 1419882049u, 2550902495u,  377792828u, 3660491170u,
+    51297038u, 3483679632u, 1093385331u, 2374089965u, 2269427188u, 1273935210u, 3311514249u,  164344343u,
+  2890961296u, 1627033870u, 4000683757u,  585078387u,  672833386u, 3836780532u, 1782552599u, 2794821769u,
+  2142603813u, 3005188795u, 1032883544u, 4047146438u, 4227826911u,  928351297u, 3118105506u, 1970307900u,
+  1396409818u, 2677114180u,  287212199u, 3719594553u, 3614542624u,  467372990u, 2505346141u, 1509854403u,
+  2162073199u, 1282711281u, 3271268626u,  240228748u,   76845205u, 3359543307u, 1186043880u, 2317064054u,
+   796964081u, 3811226735u, 1839575948u, 2702160658u, 2882189835u, 1734392469u, 3924802934u,  625327592u,
+  4234522436u,  818917338u, 3191908409u, 1927981223u, 2016387518u, 3028656416u,  973776579u, 4137723485u,
+  2857232268u, 1726474002u, 3899187441u,  616751215u,  772270454u, 3803048424u, 1814228491u, 2693328533u,
+  2041117753u, 3036871847u,  999160644u, 4146592730u, 4259508931u,  826864221u, 3217552830u, 1936586016u,
+  3606501031u,  442291769u, 2496909786u, 1484378436u, 1388107869u, 2652297411u,  278519584u, 3694387134u,
+    85183762u, 3384397196u, 1194773103u, 2342308593u, 2170143720u, 1307820918u, 3279733909u,  265733131u,
+  2057717559u, 3054258089u,  948125770u, 4096344276u, 4276898253u,  843467091u, 3167309488u, 1885556270u,
+  2839764098u, 1709792284u, 3949353983u,  667704161u,  755585656u, 3785577190u, 1865176325u, 2743489947u,
+   102594076u, 3401021058u, 1144549729u, 2291298815u, 2186770662u, 1325234296u, 3228729243u,  215514885u,
+  3589828009u,  424832311u, 2547870420u, 1534552650u, 1370645331u, 2635621325u,  328688686u, 3745342640u,
+  2211456353u, 1333405183u, 3254067740u,  224338562u,  127544219u, 3408931589u, 1170156774u, 2299866232u,
+  1345666772u, 2627681866u,  303053225u, 3736746295u, 3565105198u,  416624816u, 2522494803u, 1525692365u,
+  4285207626u,  868291796u, 3176010551u, 1910772649u, 2065767088u, 3079346734u,  956571085u, 4121828691u,
+   747507711u, 3760459617u, 1856702594u, 2717976604u, 2831417605u, 1684930971u, 3940615800u,  642451174u
+  }
 };
 
+#ifdef LODEPNG_X86_SIMD
+/*Folds 16 byte blocks into the CRC with carry-less multiplications, then Barrett reduces it
+to 32 bits ("Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel).
+length is a multiple of 16, at least 64. Takes and returns the CRC register, not inverted.*/
+LODEPNG_TARGET("pclmul,sse2")
+static unsigned lodepng_crc32_pclmul(unsigned r, const unsigned char* data, size_t length) {
+  /*bit reflected x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32), x^64 mod P, and mu, P*/
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596ll, 0x0154442bd4ll);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009ell, 0x01751997d0ll);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124ll);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641ll, 0x01db710641ll);
+  const __m128i mask32 = _mm_setr_epi32(-1, 0, -1, 0);
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i*)(data + 0));
+  x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+  x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+  x4 = _mm_loadu_si128((const __m128i*)(data + 48));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)r));
+  data += 64;
+  length -= 64;
+
+  /*4 independent folds of 64 bytes, to keep the multiplier busy*/
+  x0 = k1k2;
+  while(length >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(data + 0)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 16)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 32)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 48)));
+    data += 64;
+    length -= 64;
+  }
+
+  /*fold the 4 blocks into one, then the remaining 16 byte blocks into it*/
+  x0 = k3k4;
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+  while(length >= 16) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data)), x5);
+    data += 16;
+    length -= 16;
+  }
+
+  /*128 to 64 bits*/
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /*Barrett reduction to 32 bits*/
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif /*LODEPNG_X86_SIMD*/
+
 /*Return the CRC of the bytes buf[0..len-1].*/
 unsigned lodepng_crc32(const unsigned char* data, size_t length) {
   unsigned r = 0xffffffffu;
-  size_t i;
-  for(i = 0; i < length; ++i) {
-    r = lodepng_crc32_table[(r ^ data[i]) & 0xffu] ^ (r >> 8u);
+#ifdef LODEPNG_X86_SIMD
+  if(length >= 64 && __builtin_cpu_supports("pclmul")) {
+    size_t blocks = length & ~(size_t)15u;
+    r = lodepng_crc32_pclmul(r, data, blocks);
+    data += blocks;
+    length -= blocks;
+  }
+#endif /*LODEPNG_X86_SIMD*/
+  while(length >= 8) {
+    r ^= (unsigned)data[0] | ((unsigned)data[1] << 8u) | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u);
+    r = lodepng_crc32_table[7][r & 0xffu] ^ lodepng_crc32_table[6][(r >> 8u) & 0xffu] ^
+        lodepng_crc32_table[5][(r >> 16u) & 0xffu] ^ lodepng_crc32_table[4][(r >> 24u) & 0xffu] ^
+        lodepng_crc32_table[3][data[4]] ^ lodepng_crc32_table[2][data[5]] ^
+        lodepng_crc32_table[1][data[6]] ^ lodepng_crc32_table[0][data[7]];
+    data += 8;
+    length -= 8;
+  }
+  while(length > 0) {
+    r = lodepng_crc32_table[0][(r ^ *data) & 0xffu] ^ (r >> 8u);
+    ++data;
+    --length;
   }
   return r ^ 0xffffffffu;
 }
@@ -4054,6 +5070,133 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#ifdef LODEPNG_X86_SIMD
+/*the pixel of 3 or 4 bytes at p, in the low bytes of a vector. With avail bytes left in the scanline,
+a 3 byte pixel is loaded with the byte after it whenever there is one, that byte is never stored back*/
+LODEPNG_TARGET_INLINE("ssse3")
+static LODEPNG_INLINE __m128i unfilterLoadPixel(const unsigned char* p, size_t bytewidth, size_t avail) {
+  unsigned v = (unsigned)p[0] | ((unsigned)p[1] << 8u) | ((unsigned)p[2] << 16u);
+  if(bytewidth == 4 || avail >= 4) v |= (unsigned)p[3] << 24u;
+  return _mm_cvtsi32_si128((int)v);
+}
+
+LODEPNG_TARGET_INLINE("ssse3")
+static LODEPNG_INLINE void unfilterStorePixel(unsigned char* p, __m128i x, size_t bytewidth) {
+  unsigned v = (unsigned)_mm_cvtsi128_si32(x);
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8u);
+  p[2] = (unsigned char)(v >> 16u);
+  if(bytewidth == 4) p[3] = (unsigned char)(v >> 24u);
+}
+
+/*
+Filters of 3 and 4 byte pixels. Up goes 16 bytes at a time. Sub, Average and Paeth do all the
+channels of a pixel at once, but each pixel depends on the one at its left so they still go one
+pixel at a time. Without precon the above pixels are 0, which turns Up, Average and Paeth into the
+same formulas as the scalar code has for the first scanline. Same arguments as unfilterScanline,
+filterType is 1 to 4. With outwidth 4 and bytewidth 3, RGB pixels become RGBA with alpha 255 in
+recon and precon has RGBA pixels too, filterType may then also be 0. The channels never mix in the
+vector lanes, so the alpha lane only needs to be set when storing.
+*/
+LODEPNG_TARGET_INLINE("ssse3")
+static LODEPNG_INLINE void unfilterScanlineSsse3(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                  size_t bytewidth, size_t outwidth, unsigned char filterType, size_t length) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  /*the alpha byte of every RGBA pixel when RGB pixels are expanded*/
+  const __m128i alpha = outwidth != bytewidth ? _mm_slli_epi32(_mm_set1_epi32(255), 24) : zero;
+  __m128i a = zero; /*left pixel*/
+  __m128i b = zero; /*above pixel*/
+  __m128i c = zero; /*above left pixel*/
+  size_t i, j; /*the pixel in scanline, and in recon and precon*/
+
+  switch(filterType) {
+    case 0:
+    case 2:
+      if(outwidth == bytewidth) {
+        for(i = 0; i + 16 <= length; i += 16) {
+          __m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+          if(precon) x = _mm_add_epi8(x, _mm_loadu_si128((const __m128i*)&precon[i]));
+          _mm_storeu_si128((__m128i*)&recon[i], x);
+        }
+        for(; i != length; ++i) recon[i] = precon ? scanline[i] + precon[i] : scanline[i];
+        break;
+      }
+      /*4 RGB pixels spread over 16 bytes, as long as the 16 byte load stays in the scanline*/
+      if(filterType == 2 && !precon) filterType = 0;
+      for(i = 0, j = 0; i + 16 <= length; i += 12, j += 16) {
+        const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&scanline[i]), spread);
+        if(filterType == 2) x = _mm_add_epi8(x, _mm_loadu_si128((const __m128i*)&precon[j]));
+        _mm_storeu_si128((__m128i*)&recon[j], _mm_or_si128(x, alpha));
+      }
+      for(; i != length; i += bytewidth, j += outwidth) {
+        __m128i x = unfilterLoadPixel(&scanline[i], bytewidth, length - i);
+        if(filterType == 2) x = _mm_add_epi8(x, unfilterLoadPixel(&precon[j], outwidth, length - i));
+        unfilterStorePixel(&recon[j], _mm_or_si128(x, alpha), outwidth);
+      }
+      break;
+    case 1:
+      for(i = 0, j = 0; i != length; i += bytewidth, j += outwidth) {
+        a = _mm_add_epi8(unfilterLoadPixel(&scanline[i], bytewidth, length - i), a);
+        unfilterStorePixel(&recon[j], _mm_or_si128(a, alpha), outwidth);
+      }
+      break;
+    case 3:
+      for(i = 0, j = 0; i != length; i += bytewidth, j += outwidth) {
+        if(precon) b = unfilterLoadPixel(&precon[j], outwidth, length - i);
+        /*avg rounds up, take back the 1 where a + b is odd*/
+        a = _mm_add_epi8(unfilterLoadPixel(&scanline[i], bytewidth, length - i),
+                         _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one)));
+        unfilterStorePixel(&recon[j], _mm_or_si128(a, alpha), outwidth);
+      }
+      break;
+    default: /*4*/
+      /*in 16 bit lanes, like the shorts of paethPredictor*/
+      for(i = 0, j = 0; i != length; i += bytewidth, j += outwidth) {
+        __m128i pa, pb, pc, pred, less;
+        if(precon) b = _mm_unpacklo_epi8(unfilterLoadPixel(&precon[j], outwidth, length - i), zero);
+        pa = _mm_sub_epi16(b, c);
+        pb = _mm_sub_epi16(a, c);
+        pc = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+        pa = _mm_abs_epi16(pa);
+        pb = _mm_abs_epi16(pb);
+        /*b when pb < pa, then c when pc is less than the smallest of them, a otherwise*/
+        less = _mm_cmpgt_epi16(pa, pb);
+        pred = _mm_or_si128(_mm_andnot_si128(less, a), _mm_and_si128(less, b));
+        less = _mm_cmpgt_epi16(_mm_min_epi16(pa, pb), pc);
+        pred = _mm_or_si128(_mm_andnot_si128(less, pred), _mm_and_si128(less, c));
+        pred = _mm_add_epi8(unfilterLoadPixel(&scanline[i], bytewidth, length - i), _mm_packus_epi16(pred, pred));
+        unfilterStorePixel(&recon[j], _mm_or_si128(pred, alpha), outwidth);
+        a = _mm_unpacklo_epi8(pred, zero);
+        c = b;
+      }
+      break;
+  }
+}
+
+/*one copy for each pixel size, with all the loads and stores of whole pixels*/
+LODEPNG_TARGET("ssse3")
+static void unfilterScanline3Ssse3(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                   unsigned char filterType, size_t length) {
+  unfilterScanlineSsse3(recon, scanline, precon, 3, 3, filterType, length);
+}
+
+LODEPNG_TARGET("ssse3")
+static void unfilterScanline4Ssse3(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                   unsigned char filterType, size_t length) {
+  unfilterScanlineSsse3(recon, scanline, precon, 4, 4, filterType, length);
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+LODEPNG_TARGET("ssse3")
+static void unfilterScanline3To4Ssse3(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                      unsigned char filterType, size_t length) {
+  unfilterScanlineSsse3(recon, scanline, precon, 3, 4, filterType, length);
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+#endif /*LODEPNG_X86_SIMD*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
                                  size_t bytewidth, unsigned char filterType, size_t length) {
   /*
@@ -4066,6 +5209,14 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   */
 
   size_t i;
+#ifdef LODEPNG_X86_SIMD
+  /*RGB8 and RGBA8, the common case*/
+  if((bytewidth == 3 || bytewidth == 4) && filterType >= 1 && filterType <= 4 && __builtin_cpu_supports("ssse3")) {
+    if(bytewidth == 4) unfilterScanline4Ssse3(recon, scanline, precon, filterType, length);
+    else unfilterScanline3Ssse3(recon, scanline, precon, filterType, length);
+    return 0;
+  }
+#endif /*LODEPNG_X86_SIMD*/
   switch(filterType) {
     case 0:
       for(i = 0; i != length; ++i) recon[i] = scanline[i];
@@ -4720,17 +5871,12 @@ unsigned lodepng_inspect_chunk(LodePNGState* state, size_t pos,
   return error;
 }
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize) {
+/*read the header and all the chunks of a PNG, the data of the IDAT chunks is listed in idat (initialized here)*/
+static void decodeChunks(piecevector* idat, unsigned* w, unsigned* h,
+                         LodePNGState* state,
+                         const unsigned char* in, size_t insize) {
   unsigned char IEND = 0;
   const unsigned char* chunk;
-  size_t i;
-  ucvector idat; /*the data from idat chunks*/
-  unsigned char* scanlines = 0;
-  size_t scanlines_size = 0, expected_size = 0;
-  size_t outsize = 0;
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4738,9 +5884,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
+  piecevector_init(idat);
 
   /* safe output values in case error happens */
-  *out = 0;
   *w = *h = 0;
 
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
@@ -4750,7 +5896,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     CERROR_RETURN(state->error, 92); /*overflow possible due to amount of pixels*/
   }
 
-  ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
   /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4783,11 +5928,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT")) {
-      size_t oldsize = idat.size;
-      size_t newsize;
-      if(lodepng_addofl(oldsize, chunkLength, &newsize)) CERROR_BREAK(state->error, 95);
-      if(!ucvector_resize(&idat, newsize)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i != chunkLength; ++i) idat.data[oldsize + i] = data[i];
+      /*the data stays in the PNG, the inflator reads it there*/
+      state->error = piecevector_push_back(idat, data, chunkLength);
+      if(state->error) break;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4875,6 +6018,68 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   if(state->info_png.color.colortype == LCT_PALETTE && !state->info_png.color.palette) {
     state->error = 106; /* error: PNG file must have PLTE chunk if color type is palette */
   }
+}
+
+#ifdef LODEPNG_COMPILE_STATS
+/*start timing decoder phases, declares the time variable so use it with the declarations*/
+#define STATS_BEGIN(state, start)\
+  double start = (state)->decoder.stats ? (state)->decoder.stats->now() : 0.0
+/*add the time since start to phase and restart the time from now*/
+#define STATS_END(state, start, phase, bytes) {\
+  LodePNGDecodeStats* stats_ = (state)->decoder.stats;\
+  if(stats_) {\
+    double now_ = stats_->now();\
+    stats_->phase##_time += now_ - start;\
+    stats_->phase##_bytes += (bytes);\
+    start = now_;\
+  }\
+}
+#else /*no LODEPNG_COMPILE_STATS*/
+#define STATS_BEGIN(state, start) int start
+#define STATS_END(state, start, phase, bytes) (void)start
+#endif /*LODEPNG_COMPILE_STATS*/
+
+/*decompress the data of the IDAT chunks. The built in zlib reads it where it is in the PNG, a custom zlib or
+inflate function gets it copied together*/
+static unsigned decompressIdat(unsigned char** out, size_t* outsize, const piecevector* idat,
+                               const LodePNGDecompressSettings* settings) {
+  unsigned error;
+  unsigned char* data;
+  size_t i, pos = 0;
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(!settings->custom_zlib && !settings->custom_inflate) {
+    ucvector v;
+    ucvector_init_buffer(&v, *out, *outsize);
+    error = zlib_decompress_pieces(&v, idat->data, idat->size, idat->datasize, settings, NULL);
+    *out = v.data;
+    *outsize = v.size;
+    return error;
+  }
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  data = (unsigned char*)lodepng_malloc(idat->datasize);
+  if(!data && idat->datasize) return 83; /*alloc fail*/
+  for(i = 0; i != idat->size; ++i) {
+    lodepng_memcpy(data + pos, idat->data[i].data, idat->data[i].size);
+    pos += idat->data[i].size;
+  }
+  error = zlib_decompress(out, outsize, data, idat->datasize, settings);
+  lodepng_free(data);
+  return error;
+}
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize) {
+  piecevector idat; /*the data of the idat chunks*/
+  unsigned char* scanlines = 0;
+  size_t scanlines_size = 0, expected_size = 0;
+  size_t outsize = 0;
+  STATS_BEGIN(state, stats_start);
+
+  *out = 0;
+  decodeChunks(&idat, w, h, state, in, insize);
+  STATS_END(state, stats_start, parse, idat.datasize);
 
   /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
   If the decompressed size does not match the prediction, the image must be corrupt.*/
@@ -4903,11 +6108,11 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     scanlines_size = 0;
   }
   if(!state->error) {
-    state->error = zlib_decompress(&scanlines, &scanlines_size, idat.data,
-                                   idat.size, &state->decoder.zlibsettings);
+    state->error = decompressIdat(&scanlines, &scanlines_size, &idat, &state->decoder.zlibsettings);
     if(!state->error && scanlines_size != expected_size) state->error = 91; /*decompressed size doesn't match prediction*/
+    STATS_END(state, stats_start, inflate, scanlines_size);
   }
-  ucvector_cleanup(&idat);
+  piecevector_cleanup(&idat);
 
   if(!state->error) {
     outsize = lodepng_get_raw_size(*w, *h, &state->info_png.color);
@@ -4917,16 +6122,50 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   if(!state->error) {
     lodepng_memset(*out, 0, outsize);
     state->error = postProcessScanlines(*out, scanlines, *w, *h, &state->info_png);
+    STATS_END(state, stats_start, unfilter, outsize);
   }
   lodepng_free(scanlines);
 }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+/*whether the scanlines of the PNG can be unfiltered straight to the RGBA8 of info_raw, with no color conversion
+after it: non-interlaced RGB8 without color key and RGBA8*/
+static unsigned decodeDirectRGBA(const LodePNGState* state) {
+  const LodePNGColorMode* color = &state->info_png.color;
+  return state->decoder.color_convert && state->info_png.interlace_method == 0 &&
+         state->info_raw.colortype == LCT_RGBA && state->info_raw.bitdepth == 8 && color->bitdepth == 8 &&
+         (color->colortype == LCT_RGBA || (color->colortype == LCT_RGB && !color->key_defined));
+}
+
+static unsigned decodeRows(unsigned* w, unsigned* h, LodePNGState* state,
+                           const unsigned char* in, size_t insize,
+                           LodePNGRowCallback row_callback, void* context, unsigned char** image);
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
 unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize) {
   *out = 0;
-  decodeGeneric(out, w, h, state, in, insize);
-  if(state->error) return state->error;
+#ifdef LODEPNG_COMPILE_ZLIB
+  /*the common RGB8 and RGBA8 PNGs are unfiltered into the RGBA8 image while they are inflated, without the
+  buffer of all inflated scanlines and without color conversion*/
+  if(!state->decoder.zlibsettings.custom_zlib && !state->decoder.zlibsettings.custom_inflate &&
+     lodepng_inspect(w, h, state, in, insize) == 0 && decodeDirectRGBA(state)) {
+    decodeRows(w, h, state, in, insize, 0, 0, out);
+    if(state->error) {
+      lodepng_free(*out);
+      *out = 0;
+      return state->error;
+    }
+    /*a color key is only known once decodeRows parsed the tRNS chunk: the rows are then unfiltered in the PNG
+    color type, like those of decodeGeneric, and converted below*/
+    if(decodeDirectRGBA(state)) return 0;
+  } else
+#endif /*LODEPNG_COMPILE_ZLIB*/
+  {
+    decodeGeneric(out, w, h, state, in, insize);
+    if(state->error) return state->error;
+  }
   if(!state->decoder.color_convert || lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)) {
     /*same color type, no copying or converting of data needed*/
     /*store the info_png color settings on the info_raw so that the info_raw still reflects what colortype
@@ -4938,6 +6177,7 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   } else { /*color conversion needed*/
     unsigned char* data = *out;
     size_t outsize;
+    STATS_BEGIN(state, stats_start);
 
     /*TODO: check if this works according to the statement in the documentation: "The converter can convert
     from grayscale input color type, to 8-bit grayscale or grayscale with alpha"*/
@@ -4954,10 +6194,248 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
     else state->error = lodepng_convert(*out, data, &state->info_raw,
                                         &state->info_png.color, *w, *h);
     lodepng_free(data);
+    STATS_END(state, stats_start, convert, outsize);
+  }
+  return state->error;
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*unfilter a scanline of RGB8 (bytewidth 3) or RGBA8 (bytewidth 4) pixels straight to RGBA8, RGB8 pixels get
+alpha 255. precon and recon have RGBA8 pixels, recon and scanline must be disjoint for RGB8. Otherwise the same as
+unfilterScanline.*/
+static unsigned unfilterScanlineRGBA(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                     size_t bytewidth, unsigned char filterType, size_t length) {
+  size_t i, j;
+  unsigned k;
+  if(bytewidth == 4) return unfilterScanline(recon, scanline, precon, 4, filterType, length);
+  if(filterType > 4) return 36; /*error: nonexistent filter type given*/
+#ifdef LODEPNG_X86_SIMD
+  if(__builtin_cpu_supports("ssse3")) {
+    unfilterScanline3To4Ssse3(recon, scanline, precon, filterType, length);
+    return 0;
+  }
+#endif /*LODEPNG_X86_SIMD*/
+  for(i = 0, j = 0; i != length; i += 3, j += 4) {
+    for(k = 0; k != 3; ++k) {
+      /*the left, above and above left bytes, 0 outside of the image*/
+      unsigned char a = i ? recon[j + k - 4] : 0;
+      unsigned char b = precon ? precon[j + k] : 0;
+      unsigned char c = i && precon ? precon[j + k - 4] : 0;
+      unsigned char x = scanline[i + k];
+      if(filterType == 1) x += a;
+      else if(filterType == 2) x += b;
+      else if(filterType == 3) x += (unsigned char)((a + b) >> 1u);
+      else if(filterType == 4) x += paethPredictor(a, b, c);
+      recon[j + k] = x;
+    }
+    recon[j + 3] = 255;
+  }
+  return 0;
+}
+
+/*assembles the inflated scanlines of lodepng_decode_rows and hands out the decoded rows, or puts them in a
+whole image for lodepng_decode*/
+typedef struct RowDecoder {
+  LodePNGState* state;
+  unsigned w, h;
+  size_t bytewidth; /*bytes per pixel used by the filters, at least 1*/
+  size_t linebytes; /*bytes of a scanline, without the filter byte*/
+  unsigned char* line; /*scanline not yet complete, filter byte first*/
+  size_t linepos; /*bytes of line received*/
+  unsigned rgba; /*unfilter to RGBA8 with unfilterScanlineRGBA, see decodeDirectRGBA*/
+  unsigned char* image; /*if not NULL, the rows are unfiltered in here one after the other instead of handed out*/
+  size_t rowbytes; /*bytes of an unfiltered row*/
+  unsigned char* cur; /*unfiltered current scanline*/
+  unsigned char* prev; /*unfiltered previous scanline*/
+  unsigned char* converted; /*current row in the info_raw color mode, NULL if no conversion is needed*/
+  unsigned y; /*next row*/
+  LodePNGRowCallback row_callback;
+  void* context;
+#ifdef LODEPNG_COMPILE_STATS
+  double callback_time; /*time spent in row_callback, it is no decoding phase*/
+#endif /*LODEPNG_COMPILE_STATS*/
+} RowDecoder;
+
+/*unfilter a complete scanline (filter byte first) and hand it out*/
+static unsigned rowDecoderLine(RowDecoder* dec, const unsigned char* scanline) {
+  unsigned char* swap;
+  const unsigned char* row = dec->cur;
+  const unsigned char* precon = dec->y ? dec->prev : 0;
+  STATS_BEGIN(dec->state, stats_start);
+
+  if(dec->y >= dec->h) return 91; /*decompressed size doesn't match prediction*/
+  if(dec->rgba) {
+    CERROR_TRY_RETURN(unfilterScanlineRGBA(dec->cur, scanline + 1, precon, dec->bytewidth, scanline[0], dec->linebytes));
+  } else {
+    CERROR_TRY_RETURN(unfilterScanline(dec->cur, scanline + 1, precon, dec->bytewidth, scanline[0], dec->linebytes));
+  }
+  STATS_END(dec->state, stats_start, unfilter, dec->linebytes);
+  if(dec->image) {
+    /*the row stays where it is, it is the previous one of the next row*/
+    dec->prev = dec->cur;
+    dec->cur += dec->rowbytes;
+    ++dec->y;
+    return 0;
   }
+  if(dec->converted) {
+    CERROR_TRY_RETURN(lodepng_convert(dec->converted, dec->cur, &dec->state->info_raw,
+                                      &dec->state->info_png.color, dec->w, 1));
+    row = dec->converted;
+    STATS_END(dec->state, stats_start, convert, lodepng_get_raw_size(dec->w, 1, &dec->state->info_raw));
+  }
+  CERROR_TRY_RETURN(dec->row_callback(dec->context, dec->y, row));
+#ifdef LODEPNG_COMPILE_STATS
+  if(dec->state->decoder.stats) dec->callback_time += dec->state->decoder.stats->now() - stats_start;
+#endif /*LODEPNG_COMPILE_STATS*/
+
+  swap = dec->prev;
+  dec->prev = dec->cur;
+  dec->cur = swap;
+  ++dec->y;
+  return 0;
+}
+
+/*InflateSink consumer: split the inflated data in scanlines*/
+static unsigned rowDecoderConsume(void* context, const unsigned char* data, size_t size) {
+  RowDecoder* dec = (RowDecoder*)context;
+  size_t scanlinebytes = dec->linebytes + 1u;
+
+  while(size > 0) {
+    if(dec->linepos == 0 && size >= scanlinebytes) {
+      /*whole scanline available, unfilter it in place*/
+      CERROR_TRY_RETURN(rowDecoderLine(dec, data));
+      data += scanlinebytes;
+      size -= scanlinebytes;
+    } else {
+      size_t n = LODEPNG_MIN(size, scanlinebytes - dec->linepos);
+      lodepng_memcpy(dec->line + dec->linepos, data, n);
+      dec->linepos += n;
+      data += n;
+      size -= n;
+      if(dec->linepos == scanlinebytes) {
+        CERROR_TRY_RETURN(rowDecoderLine(dec, dec->line));
+        dec->linepos = 0;
+      }
+    }
+  }
+  return 0;
+}
+
+/*decode a non-interlaced PNG a row at a time while inflating: the rows go to row_callback, or with image given
+(for 8 bit PNGs only, without padding bits) into an image allocated in *image*: RGBA8 if decodeDirectRGBA still holds
+after the chunks are parsed, else in the PNG color type*/
+static unsigned decodeRows(unsigned* w, unsigned* h, LodePNGState* state,
+                           const unsigned char* in, size_t insize,
+                           LodePNGRowCallback row_callback, void* context, unsigned char** image) {
+  piecevector idat;
+  RowDecoder dec;
+  InflateSink sink;
+  unsigned bpp;
+  STATS_BEGIN(state, stats_start);
+
+  decodeChunks(&idat, w, h, state, in, insize);
+  STATS_END(state, stats_start, parse, idat.datasize);
+  if(!state->error && state->info_png.interlace_method != 0) state->error = 109;
+  if(!state->error && state->decoder.color_convert &&
+     !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color) &&
+     !(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA) &&
+     !(state->info_raw.bitdepth == 8)) {
+    state->error = 56; /*unsupported color mode conversion*/
+  }
+  if(state->error) {
+    piecevector_cleanup(&idat);
+    return state->error;
+  }
+  if(!state->decoder.color_convert) {
+    state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+    if(state->error) {
+      piecevector_cleanup(&idat);
+      return state->error;
+    }
+  }
+
+  bpp = lodepng_get_bpp(&state->info_png.color);
+  dec.state = state;
+  dec.w = *w;
+  dec.h = *h;
+  dec.bytewidth = (bpp + 7u) / 8u;
+  dec.linebytes = lodepng_get_raw_size_idat(*w, 1, bpp) - 1u;
+  dec.linepos = 0;
+  dec.rgba = decodeDirectRGBA(state);
+  dec.rowbytes = dec.rgba ? (size_t)(*w) * 4u : dec.linebytes;
+  dec.y = 0;
+  dec.row_callback = row_callback;
+  dec.context = context;
+  dec.line = (unsigned char*)lodepng_malloc(dec.linebytes + 1u);
+  dec.image = 0;
+  dec.cur = 0;
+  dec.prev = 0;
+  dec.converted = 0;
+#ifdef LODEPNG_COMPILE_STATS
+  dec.callback_time = 0.0;
+#endif /*LODEPNG_COMPILE_STATS*/
+  if(image) {
+    /*the pixel count was checked against overflow by decodeChunks*/
+    dec.image = dec.cur = *image = (unsigned char*)lodepng_malloc(dec.rowbytes * dec.h);
+    if(!dec.image) state->error = 83; /*alloc fail*/
+  } else {
+    dec.cur = (unsigned char*)lodepng_malloc(dec.rowbytes);
+    dec.prev = (unsigned char*)lodepng_malloc(dec.rowbytes);
+    if(!dec.cur || !dec.prev) state->error = 83; /*alloc fail*/
+    if(!dec.rgba && !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)) {
+      dec.converted = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(*w, 1, &state->info_raw));
+      if(!dec.converted) state->error = 83; /*alloc fail*/
+    }
+  }
+  if(!dec.line) state->error = 83; /*alloc fail*/
+
+  if(!state->error) {
+#ifdef LODEPNG_COMPILE_STATS
+    /*inflating is interleaved with the rows, it gets the stream time the rows did not use*/
+    LodePNGDecodeStats* stats = state->decoder.stats;
+    double rows_time = stats ? stats->unfilter_time + stats->convert_time : 0.0;
+    if(stats) stats_start = stats->now();
+#endif /*LODEPNG_COMPILE_STATS*/
+    sink.consume = rowDecoderConsume;
+    sink.context = &dec;
+    state->error = zlib_decompress_pieces(NULL, idat.data, idat.size, idat.datasize, &state->decoder.zlibsettings,
+                                          &sink);
+    /*decompressed size doesn't match prediction*/
+    if(!state->error && (dec.y != dec.h || dec.linepos != 0)) state->error = 91;
+#ifdef LODEPNG_COMPILE_STATS
+    if(stats) {
+      rows_time = stats->unfilter_time + stats->convert_time - rows_time + dec.callback_time;
+      stats->inflate_time += stats->now() - stats_start - rows_time;
+      stats->inflate_bytes += (size_t)dec.y * (dec.linebytes + 1u) + dec.linepos;
+    }
+#endif /*LODEPNG_COMPILE_STATS*/
+  }
+
+  lodepng_free(dec.line);
+  if(!image) {
+    lodepng_free(dec.cur);
+    lodepng_free(dec.prev);
+  }
+  lodepng_free(dec.converted);
+  piecevector_cleanup(&idat);
   return state->error;
 }
 
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback row_callback, void* context) {
+  return decodeRows(w, h, state, in, insize, row_callback, context, NULL);
+}
+#else /*no LODEPNG_COMPILE_ZLIB*/
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback row_callback, void* context) {
+  (void)in; (void)insize; (void)row_callback; (void)context;
+  *w = *h = 0;
+  return state->error = 87; /*the streaming decoder needs the built in zlib*/
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth) {
   unsigned error;
@@ -5011,6 +6489,7 @@ void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings) {
   settings->ignore_crc = 0;
   settings->ignore_critical = 0;
   settings->ignore_end = 0;
+  settings->stats = 0;
   lodepng_decompress_settings_init(&settings->zlibsettings);
 }
 
@@ -6192,6 +7671,7 @@ const char* lodepng_error_text(unsigned code) {
     case 106: return "PNG file must have PLTE chunk if color type is palette";
     case 107: return "color convert from palette mode requested without setting the palette data in it";
     case 108: return "tried to add more than 256 values to a palette";
+    case 109: return "lodepng_decode_rows does not support Adam7 interlaced images";
   }
   return "unknown error code";
 }
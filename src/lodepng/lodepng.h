@@ -82,6 +82,15 @@ source files with custom allocators.*/
 #define LODEPNG_COMPILE_ALLOCATORS
 #endif
 
+/*per phase timing of the decoder, see LodePNGDecodeStats. This one is off by
+default: define LODEPNG_COMPILE_STATS to compile it in.*/
+
+/*SIMD versions of the hot loops (CRC32, ...) for x86-64 with gcc or clang, each one
+used only when the cpu running the code supports it*/
+#ifndef LODEPNG_NO_COMPILE_CPU_DISPATCH
+#define LODEPNG_COMPILE_CPU_DISPATCH
+#endif
+
 /*compile the C++ version (you can disable the C++ wrapper here even when compiling for C++)*/
 #ifdef __cplusplus
 #ifndef LODEPNG_NO_COMPILE_CPP
@@ -263,6 +272,18 @@ const char* lodepng_error_text(unsigned code);
 #endif /*LODEPNG_COMPILE_ERROR_TEXT*/
 
 #ifdef LODEPNG_COMPILE_DECODER
+/*Decoder memory kept from an image to the next one, for programs decoding many images in a row
+(such as a batch of small icons): the Huffman trees of the blocks with fixed tree are built only once
+and the lookup tables of inflate are not allocated for every block. All of it is allocated by
+lodepng_scratch_init and nothing more afterwards. It is not thread safe, each thread needs its own.*/
+typedef struct LodePNGDecoderScratch {
+  void* data; /*internal, NULL when not initialized*/
+} LodePNGDecoderScratch;
+
+/*returns error code, 83 when out of memory*/
+unsigned lodepng_scratch_init(LodePNGDecoderScratch* scratch);
+void lodepng_scratch_cleanup(LodePNGDecoderScratch* scratch);
+
 /*Settings for zlib decompression*/
 typedef struct LodePNGDecompressSettings LodePNGDecompressSettings;
 struct LodePNGDecompressSettings {
@@ -281,6 +302,8 @@ struct LodePNGDecompressSettings {
                              const LodePNGDecompressSettings*);
 
   const void* custom_context; /*optional custom settings for custom functions*/
+
+  LodePNGDecoderScratch* scratch; /*memory reused by the built in inflate, see LodePNGDecoderScratch. Default: NULL*/
 };
 
 extern const LodePNGDecompressSettings lodepng_default_decompress_settings;
@@ -623,6 +646,25 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
 Settings for the decoder. This contains settings for the PNG and the Zlib
 decoder, but not the Info settings from the Info structs.
 */
+/*
+Wall clock time in seconds and output bytes of each decoding phase. The
+decoder adds to the fields, so zero them before the first image. now must
+return a monotonic time in seconds, lodepng has no clock of its own.
+Declared in every build so LodePNGDecoderSettings has the same layout with
+and without LODEPNG_COMPILE_STATS, only filled when it is defined.
+*/
+typedef struct LodePNGDecodeStats {
+  double (*now)(void);
+  double parse_time; /*chunk parsing and IDAT collection*/
+  size_t parse_bytes; /*size of the concatenated IDAT data*/
+  double inflate_time; /*zlib decompression*/
+  size_t inflate_bytes; /*size of the filtered scanlines*/
+  double unfilter_time; /*unfiltering and Adam7 deinterlacing*/
+  size_t unfilter_bytes; /*size of the image in the PNG color type*/
+  double convert_time; /*conversion to info_raw, 0 if the color types are equal*/
+  size_t convert_bytes; /*size of the image in the info_raw color type*/
+} LodePNGDecodeStats;
+
 typedef struct LodePNGDecoderSettings {
   LodePNGDecompressSettings zlibsettings; /*in here is the setting to ignore Adler32 checksums*/
 
@@ -642,6 +684,10 @@ typedef struct LodePNGDecoderSettings {
   /*store all bytes from unknown chunks in the LodePNGInfo (off by default, useful for a png editor)*/
   unsigned remember_unknown_chunks;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
+
+  /*if not NULL, the time of every decoding phase is added here, ignored without
+  LODEPNG_COMPILE_STATS. Default: NULL*/
+  LodePNGDecodeStats* stats;
 } LodePNGDecoderSettings;
 
 void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings);
@@ -771,6 +817,21 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
                          LodePNGState* state,
                          const unsigned char* in, size_t insize);
+
+/*receives the rows of lodepng_decode_rows, y is the row index. Returns 0 to continue or an error code to stop.*/
+typedef unsigned (*LodePNGRowCallback)(void* context, unsigned y, const unsigned char* row);
+
+/*
+Same as lodepng_decode, but the image is never held in memory as a whole: the
+IDAT data is inflated in pieces and every row is unfiltered, converted to
+info_raw and handed to row_callback as soon as it is complete, from the top.
+Apart from the IDAT data memory use is a few rows plus the inflate window.
+Only non interlaced images are supported (error 109 for Adam7 images, decode
+those with lodepng_decode). custom_zlib and custom_inflate are not used.
+*/
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             LodePNGRowCallback row_callback, void* context);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /*